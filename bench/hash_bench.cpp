@@ -0,0 +1,243 @@
+#include "benchmark/benchmark.h"
+#include "hash_lib.h"
+#include "cpu_util.h"
+#include <string.h>
+
+using namespace hash_lib;
+
+// Message sizes of the per-algorithm benchmarks, from 16 B to 64 MB
+static const std::vector<int64_t> MESSAGE_SIZES = { 16, 64, 256, 1 << 10, 4 << 10, 64 << 10, 1 << 20, 64 << 20 };
+// Batches hold 64 messages, so they stop at 64 KB
+static const std::vector<int64_t> BATCH_SIZES = { 16, 64, 256, 1 << 10, 4 << 10, 64 << 10 };
+
+// Arguments: message size, whether hardware acceleration is enabled.
+template<class H>
+static void BM_Hash(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'a');
+    setHardwareAcceleration(state.range(1));
+    for (auto _ : state) {
+        auto re = hash<H>(data);
+        benchmark::DoNotOptimize(re);
+    }
+    setHardwareAcceleration(true);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Arguments: file size. Hashing through Hash::update(FILE*), the file stays in the page cache.
+template<class H>
+static void BM_HashFILE(benchmark::State& state) {
+    FILE* f = tmpfile();
+    std::vector<uint8_t> data(state.range(0), 'a');
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+        if (f) fclose(f);
+        state.SkipWithError("Can not write the temporary file");
+        return;
+    }
+    H h;
+    for (auto _ : state) {
+        rewind(f);
+        h.reset();
+        h.update(f);
+        benchmark::DoNotOptimize(h.digest());
+    }
+    fclose(f);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Arguments: message size. Fixed-size digests without heap allocation or virtual calls.
+template<class H>
+static void BM_HashDigest(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'a');
+    for (auto _ : state) {
+        auto re = hashDigest<H>(data);
+        benchmark::DoNotOptimize(re);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_HashDigest, SHA256)->Arg(16)->Arg(64)->ArgName("bytes");
+BENCHMARK_TEMPLATE(BM_HashDigest, XXH3_64)->Arg(16)->Arg(64)->ArgName("bytes");
+
+// Arguments: message size, count of threads.
+static void BM_BLAKE3Threads(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'a');
+    for (auto _ : state) {
+        auto re = hash<BLAKE3>(data, (unsigned int)state.range(1));
+        benchmark::DoNotOptimize(re);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_BLAKE3Threads)->ArgsProduct({{16 << 20}, {1, 2, 4, 8}})->ArgNames({"bytes", "threads"})->UseRealTime();
+
+// Arguments: file size, count of threads. hashFile reads large chunks when threads are used.
+static void BM_BLAKE3FileThreads(benchmark::State& state) {
+    FILE* f = tmpfile();
+    std::vector<uint8_t> data(state.range(0), 'a');
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size() || fflush(f) != 0) {
+        if (f) fclose(f);
+        state.SkipWithError("Can not write the temporary file");
+        return;
+    }
+    BLAKE3 h((unsigned int)state.range(1));
+    for (auto _ : state) {
+        rewind(f);
+        h.reset();
+        h.update(f);
+        benchmark::DoNotOptimize(h.digest());
+    }
+    fclose(f);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_BLAKE3FileThreads)->ArgsProduct({{256 << 20}, {1, 2, 4, 8}})->ArgNames({"bytes", "threads"})->UseRealTime();
+
+// Arguments: key size. Hashing of short keys, as done by hash maps.
+static void BM_XXH3Hasher(benchmark::State& state) {
+    std::string key(state.range(0), 'a');
+    XXH3Hasher hasher;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hasher(key));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_XXH3Hasher)->Arg(8)->Arg(16)->Arg(64)->ArgName("bytes");
+
+// Arguments: message size. Many messages signed with the same key.
+template<class H>
+static void BM_HMAC(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'a');
+    HMAC<H> hmac("0123456789abcdef0123456789abcdef");
+    uint8_t out[64];
+    for (auto _ : state) {
+        hmac.reset();
+        hmac.update(data.data(), data.size())->finish(out, sizeof(out));
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Arguments: count of iterations.
+template<class H>
+static void BM_PBKDF2(benchmark::State& state) {
+    for (auto _ : state) {
+        auto re = pbkdf2<H>("password", "salt", state.range(0), 32);
+        benchmark::DoNotOptimize(re);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_PBKDF2, SHA1)->Arg(10000)->ArgName("iterations");
+BENCHMARK_TEMPLATE(BM_PBKDF2, SHA256)->Arg(10000)->ArgName("iterations");
+BENCHMARK_TEMPLATE(BM_PBKDF2, SHA512)->Arg(10000)->ArgName("iterations");
+
+// Arguments: size of every update call, offset of the first update.
+// A non-zero offset leaves a partial block in the buffer before every call.
+template<class H>
+static void BM_Update(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0), 'a');
+    H h;
+    h.update(data.data(), state.range(1));
+    for (auto _ : state) {
+        h.update(data.data(), data.size());
+    }
+    benchmark::DoNotOptimize(h.digest());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_Update, SHA1)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1}})->ArgNames({"bytes", "offset"});
+BENCHMARK_TEMPLATE(BM_Update, SHA256)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1}})->ArgNames({"bytes", "offset"});
+BENCHMARK_TEMPLATE(BM_Update, SHA512)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1}})->ArgNames({"bytes", "offset"});
+BENCHMARK_TEMPLATE(BM_Update, MD5)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1}})->ArgNames({"bytes", "offset"});
+
+// Arguments: message size, count of messages.
+template<class H>
+static void BM_HashBatch(benchmark::State& state) {
+    std::vector<std::vector<uint8_t>> data(state.range(1), std::vector<uint8_t>(state.range(0), 'a'));
+    for (auto _ : state) {
+        auto re = hashBatch<H>(data);
+        benchmark::DoNotOptimize(re);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+
+// Arguments: average chunk size. Boundary scan only, over random data.
+static void BM_FastCDC(benchmark::State& state) {
+    std::vector<uint8_t> data(64 << 20);
+    uint64_t x = 1;
+    for (auto& i : data) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        i = (uint8_t)(x >> 56);
+    }
+    FastCDC cdc(state.range(0) / 4, state.range(0), state.range(0) * 8);
+    for (auto _ : state) {
+        size_t count = 0;
+        for (size_t offset = 0; offset < data.size(); count++) {
+            offset += cdc.cut(data.data() + offset, data.size() - offset);
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+BENCHMARK(BM_FastCDC)->Arg(8 << 10)->Arg(64 << 10)->ArgName("avg");
+
+/**
+ * Register the in-memory, FILE*, batched and HMAC benchmarks of an algorithm
+ * @param name Name of the algorithm in the benchmark names
+ * @param hmac Whether HMAC makes sense with the algorithm
+ */
+template<class H>
+static void registerAlgorithm(const std::string& name, bool hmac) {
+    benchmark::RegisterBenchmark(("BM_Hash<" + name + ">").c_str(), BM_Hash<H>)->ArgsProduct({ MESSAGE_SIZES, { 0, 1 } })->ArgNames({ "bytes", "hw" });
+    benchmark::RegisterBenchmark(("BM_HashFILE<" + name + ">").c_str(), BM_HashFILE<H>)->ArgsProduct({ MESSAGE_SIZES })->ArgNames({ "bytes" });
+    benchmark::RegisterBenchmark(("BM_HashBatch<" + name + ">").c_str(), BM_HashBatch<H>)->ArgsProduct({ BATCH_SIZES, { 64 } })->ArgNames({ "bytes", "count" });
+    if (hmac) {
+        benchmark::RegisterBenchmark(("BM_HMAC<" + name + ">").c_str(), BM_HMAC<H>)->ArgsProduct({ MESSAGE_SIZES })->ArgNames({ "bytes" });
+    }
+}
+
+// Output is JSON unless --benchmark_format is given, so runs can be diffed across commits and CPUs
+// (e.g. with tools/compare.py of Google Benchmark). Use --benchmark_filter to run a subset.
+int main(int argc, char** argv) {
+    registerAlgorithm<SHA1>("SHA1", true);
+    registerAlgorithm<SHA224>("SHA224", true);
+    registerAlgorithm<SHA256>("SHA256", true);
+    registerAlgorithm<SHA384>("SHA384", true);
+    registerAlgorithm<SHA512>("SHA512", true);
+    registerAlgorithm<SHA512_256>("SHA512_256", true);
+    registerAlgorithm<MD5>("MD5", true);
+    registerAlgorithm<SHA3_224>("SHA3_224", true);
+    registerAlgorithm<SHA3_256>("SHA3_256", true);
+    registerAlgorithm<SHA3_384>("SHA3_384", true);
+    registerAlgorithm<SHA3_512>("SHA3_512", true);
+    registerAlgorithm<SHAKE128>("SHAKE128", true);
+    registerAlgorithm<SHAKE256>("SHAKE256", true);
+    registerAlgorithm<BLAKE3>("BLAKE3", true);
+    registerAlgorithm<CRC32>("CRC32", false);
+    registerAlgorithm<CRC32C>("CRC32C", false);
+    registerAlgorithm<XXH3_64>("XXH3_64", false);
+    registerAlgorithm<XXH3_128>("XXH3_128", false);
+    std::vector<char*> args(argv, argv + argc);
+    static char jsonFormat[] = "--benchmark_format=json";
+    bool hasFormat = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--benchmark_format", 18)) hasFormat = true;
+    }
+    if (!hasFormat) args.insert(args.begin() + 1, jsonFormat);
+    int count = (int)args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    // The implementations picked at runtime depend on these
+    benchmark::AddCustomContext("x86_sha", cpu_util::has_x86_sha() ? "true" : "false");
+    benchmark::AddCustomContext("avx2", cpu_util::has_avx2() ? "true" : "false");
+    benchmark::AddCustomContext("avx512f", cpu_util::has_avx512f() ? "true" : "false");
+    benchmark::AddCustomContext("sse42", cpu_util::has_sse42() ? "true" : "false");
+    benchmark::AddCustomContext("pclmul", cpu_util::has_pclmul() ? "true" : "false");
+    benchmark::AddCustomContext("arm_sha2", cpu_util::has_arm_sha2() ? "true" : "false");
+    benchmark::AddCustomContext("arm_crc32", cpu_util::has_arm_crc32() ? "true" : "false");
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "benchmark/benchmark.h"
+#include "stream.h"
+#include <memory>
+#include <string>
+
+static const char* BENCH_FILE = "stream_bench.bin";
+static const int64_t FILE_SIZE = 64 << 20;
+static const size_t READ_SIZE = 4096;
+
+static void createFile(const benchmark::State&) {
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 13 + (i >> 8));
+    FILE* f = fileop::fopen(BENCH_FILE, "wb");
+    if (!f) return;
+    for (int64_t written = 0; written < FILE_SIZE; written += data.size()) {
+        fwrite(data.data(), 1, data.size(), f);
+    }
+    fileop::fclose(f);
+}
+
+static void removeFile(const benchmark::State&) {
+    fileop::remove(BENCH_FILE);
+}
+
+/**
+ * Random 4 KB reads through read_at, every thread shares one stream
+ * Arguments: none, the count of threads is given by ThreadRange.
+ */
+template<class S>
+static void BM_ReadAt(benchmark::State& state) {
+    static std::unique_ptr<S> stream;
+    if (state.thread_index() == 0) {
+        stream.reset(new S(BENCH_FILE));
+    }
+    // The first iteration is a barrier of all threads, stream is ready after it
+    uint8_t buf[READ_SIZE];
+    uint64_t x = state.thread_index() + 1;
+    for (auto _ : state) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        int64_t offset = (int64_t)((x >> 33) % (FILE_SIZE / READ_SIZE)) * READ_SIZE;
+        if (stream->read_at(buf, READ_SIZE, offset) != READ_SIZE) {
+            state.SkipWithError("Short read");
+            break;
+        }
+        benchmark::DoNotOptimize(buf);
+    }
+    // The end of the loop is a barrier too
+    if (state.thread_index() == 0) {
+        stream.reset();
+    }
+    state.SetBytesProcessed(state.iterations() * READ_SIZE);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_ReadAt, FileReadStream)->ThreadRange(1, 32)->UseRealTime()->Setup(createFile)->Teardown(removeFile);
+BENCHMARK_TEMPLATE(BM_ReadAt, MmapReadStream)->ThreadRange(1, 32)->UseRealTime()->Setup(createFile)->Teardown(removeFile);
+
+/**
+ * Parsing a region of a file field by field with readu32
+ * Arguments: whether reads go through a BufferedReadStream.
+ */
+static void BM_ReadU32(benchmark::State& state) {
+    FileReadStream file(BENCH_FILE);
+    const int64_t size = 1 << 20;
+    ReadStreamRegion region(&file, 4096, 4096 + size);
+    BufferedReadStream buffered(&region);
+    ReadStream* stream = state.range(0) ? (ReadStream*)&buffered : &region;
+    for (auto _ : state) {
+        stream->seek(0, SEEK_SET);
+        uint32_t value, sum = 0;
+        while (stream->readu32(value)) sum += value;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_ReadU32)->Arg(0)->Arg(1)->ArgName("buffered")->Setup(createFile)->Teardown(removeFile);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,143 @@
+#include "cpu_util.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_UTIL_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_UTIL_ARM64 1
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1 (1 << 5)
+#endif
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+#endif
+
+struct CpuFeatures {
+    bool x86_sha = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool arm_sha1 = false;
+    bool arm_sha2 = false;
+    bool sse42 = false;
+    bool pclmul = false;
+    bool arm_crc32 = false;
+};
+
+#if CPU_UTIL_X86
+static bool cpuid(uint32_t leaf, uint32_t subleaf, uint32_t (&regs)[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 0);
+    if ((uint32_t)r[0] < leaf) return false;
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = r[i];
+    return true;
+#else
+    if (__get_cpuid_max(0, nullptr) < leaf) return false;
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+    return true;
+#endif
+}
+
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+static CpuFeatures detect_features() {
+    CpuFeatures f;
+#if CPU_UTIL_X86
+    uint32_t regs[4];
+    bool ssse3 = false, sse41 = false, avx = false, ymm = false, zmm = false;
+    if (cpuid(1, 0, regs)) {
+        ssse3 = regs[2] & (1 << 9);
+        sse41 = regs[2] & (1 << 19);
+        avx = regs[2] & (1 << 28);
+        f.sse42 = regs[2] & (1 << 20);
+        f.pclmul = sse41 && (regs[2] & (1 << 1));
+        // OSXSAVE: the OS saves the extended registers on context switch.
+        if (regs[2] & (1 << 27)) {
+            uint64_t xcr0 = xgetbv0();
+            ymm = (xcr0 & 0x6) == 0x6;
+            zmm = (xcr0 & 0xe6) == 0xe6;
+        }
+    }
+    if (cpuid(7, 0, regs)) {
+        f.x86_sha = ssse3 && sse41 && (regs[1] & (1 << 29));
+        f.avx2 = avx && ymm && (regs[1] & (1 << 5));
+        f.avx512f = f.avx2 && zmm && (regs[1] & (1 << 16));
+    }
+#elif CPU_UTIL_ARM64
+#if defined(__APPLE__)
+    f.arm_sha1 = true;
+    f.arm_sha2 = true;
+    f.arm_crc32 = true;
+#elif defined(_WIN32)
+    f.arm_sha1 = f.arm_sha2 = IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+    f.arm_crc32 = IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+#elif defined(__linux__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    f.arm_sha1 = hwcap & HWCAP_SHA1;
+    f.arm_sha2 = hwcap & HWCAP_SHA2;
+    f.arm_crc32 = hwcap & HWCAP_CRC32;
+#endif
+#endif
+    return f;
+}
+
+static const CpuFeatures& features() {
+    static const CpuFeatures f = detect_features();
+    return f;
+}
+
+bool cpu_util::has_x86_sha() {
+    return features().x86_sha;
+}
+
+bool cpu_util::has_avx2() {
+    return features().avx2;
+}
+
+bool cpu_util::has_avx512f() {
+    return features().avx512f;
+}
+
+bool cpu_util::has_arm_sha2() {
+    return features().arm_sha2;
+}
+
+bool cpu_util::has_arm_sha1() {
+    return features().arm_sha1;
+}
+
+bool cpu_util::has_sse42() {
+    return features().sse42;
+}
+
+bool cpu_util::has_pclmul() {
+    return features().pclmul;
+}
+
+bool cpu_util::has_arm_crc32() {
+    return features().arm_crc32;
+}
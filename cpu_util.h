@@ -0,0 +1,45 @@
+#ifndef _UTIL_CPU_UTIL_H
+#define _UTIL_CPU_UTIL_H
+namespace cpu_util {
+    /**
+     * @brief Check if the CPU supports x86 SHA extensions (SHA-NI) together with SSSE3 and SSE4.1.
+     * @return true if supported
+    */
+    bool has_x86_sha();
+    /**
+     * @brief Check if the CPU and OS support AVX2.
+     * @return true if supported
+    */
+    bool has_avx2();
+    /**
+     * @brief Check if the CPU and OS support AVX-512 Foundation.
+     * @return true if supported
+    */
+    bool has_avx512f();
+    /**
+     * @brief Check if the CPU supports ARMv8 SHA-256 instructions.
+     * @return true if supported
+    */
+    bool has_arm_sha2();
+    /**
+     * @brief Check if the CPU supports ARMv8 SHA-1 instructions.
+     * @return true if supported
+    */
+    bool has_arm_sha1();
+    /**
+     * @brief Check if the CPU supports SSE4.2 (including the crc32 instruction).
+     * @return true if supported
+    */
+    bool has_sse42();
+    /**
+     * @brief Check if the CPU supports carry-less multiplication (PCLMULQDQ) together with SSE4.1.
+     * @return true if supported
+    */
+    bool has_pclmul();
+    /**
+     * @brief Check if the CPU supports ARMv8 CRC32 instructions.
+     * @return true if supported
+    */
+    bool has_arm_crc32();
+}
+#endif
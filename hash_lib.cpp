@@ -1,6 +1,25 @@
 #include "hash_lib.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <errno.h>
 #include <string.h>
 #include "cstr_util.h"
+#include "cpu_util.h"
+#include "str_util.h"
+#include "hash_lib_internal.h"
+#if _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define SHA512_DIGEST_LENGTH 64
 #define SHA512_BLOCK_SIZE 128
@@ -13,14 +32,65 @@
 #define SHA1_BLOCK_SIZE 64
 #define MD5_DIGEST_LENGTH 16
 #define MD5_BLOCK_SIZE 64
+#define FILE_READ_CHUNK (1 << 20)
+#if SIZE_MAX > 0xffffffff
+#define FILE_MAP_WINDOW ((int64_t)1 << 30)
+#else
+#define FILE_MAP_WINDOW ((int64_t)1 << 26)
+#endif
 
 using namespace hash_lib;
 
+static std::atomic<bool> hardwareEnabled(true);
+
+void hash_lib::setHardwareAcceleration(bool enabled) {
+    hardwareEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool hash_lib::hardwareAcceleration() {
+    return hardwareEnabled.load(std::memory_order_relaxed);
+}
+
+bool hash_lib::internal::useHardware() {
+    return hardwareEnabled.load(std::memory_order_relaxed);
+}
+
 template<size_t T, class Type>
 void cleanBuffer(Type(&buffer)[T]) {
     memset(buffer, 0, sizeof(Type) * T);
 }
 
+/**
+ * Feed data to a block based hash.
+ * Whole blocks are hashed directly from data, only a partial block at the start or the end is copied to buffer.
+ * @param hashBlocks Callback to hash blocks, its length is always a multiple of blockSize
+ */
+template<class F>
+static inline void blockUpdate(uint8_t* buffer, size_t& bufferLength, size_t blockSize, const uint8_t* data, size_t len, F hashBlocks) {
+    // data may be null for an empty update
+    if (len == 0) return;
+    if (bufferLength > 0) {
+        size_t n = blockSize - bufferLength < len ? blockSize - bufferLength : len;
+        memcpy(buffer + bufferLength, data, n);
+        bufferLength += n;
+        data += n;
+        len -= n;
+        if (bufferLength < blockSize) return;
+        hashBlocks(buffer, blockSize);
+        bufferLength = 0;
+    }
+    if (len >= blockSize) {
+        size_t whole = len - len % blockSize;
+        hashBlocks(data, whole);
+        data += whole;
+        len -= whole;
+    }
+    if (len > 0) {
+        memcpy(buffer, data, len);
+        bufferLength = len;
+    }
+}
+
 Hash* Hash::update(const std::string& data) {
     return this->update((const uint8_t*)data.c_str(), data.size());
 }
@@ -29,16 +99,169 @@ Hash* Hash::update(const std::vector<uint8_t>& data) {
     return this->update(data.data(), data.size());
 }
 
+size_t Hash::fileReadSize() {
+    return FILE_READ_CHUNK;
+}
+
+/**
+ * Size of the buffer to read a file with, so small files do not pay for a large buffer
+ * @param size Bytes left in the file, negative if unknown
+ * @param chunk Largest read
+ */
+static size_t readBufferSize(int64_t size, size_t chunk) {
+    if (size < 0 || (uint64_t)size >= chunk) return chunk;
+    // Files such as those of procfs report no size
+    if (size == 0) return 4096;
+    return (size_t)size;
+}
+
 Hash* Hash::update(FILE* f) {
     if (!f) return this;
-    uint8_t buffer[1024];
+    int64_t size = -1;
+#if _WIN32
+    int64_t length = _filelengthi64(_fileno(f));
+    int64_t pos = _ftelli64(f);
+    if (length >= 0 && pos >= 0) size = length > pos ? length - pos : 0;
+#else
+    struct stat st;
+    off_t pos = ftello(f);
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) && pos >= 0) size = st.st_size > pos ? st.st_size - pos : 0;
+#endif
+    size_t len = readBufferSize(size, fileReadSize());
+    // Not zero-filled, the buffer is only read after fread wrote it
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[len]);
     size_t read;
-    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {\
-        this->update(buffer, read);
+    while ((read = fread(buffer.get(), 1, len, f)) > 0) {
+        this->update(buffer.get(), read);
     }
     return this;
 }
 
+#if !_WIN32
+static bool updateRead(Hash* h, int fd, int64_t offset, int64_t size, size_t chunk) {
+    size_t len = readBufferSize(size, chunk);
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[len]);
+    while (true) {
+        ssize_t re = offset >= 0 ? pread(fd, buffer.get(), len, offset) : read(fd, buffer.get(), len);
+        if (re < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (re == 0) return true;
+        h->update(buffer.get(), re);
+        if (offset >= 0) offset += re;
+    }
+}
+
+static bool updateMapped(Hash* h, int fd, int64_t size, size_t chunk) {
+    int64_t offset = 0;
+    while (offset < size) {
+        size_t len = (size_t)(size - offset < FILE_MAP_WINDOW ? size - offset : FILE_MAP_WINDOW);
+        void* m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, offset);
+        if (m == MAP_FAILED) {
+            // Some file systems can not be mapped, read the rest of the file instead.
+            return updateRead(h, fd, offset, size - offset, chunk);
+        }
+        madvise(m, len, MADV_SEQUENTIAL);
+        h->update((const uint8_t*)m, len);
+        munmap(m, len);
+        offset += len;
+    }
+    return true;
+}
+#endif
+
+bool Hash::updateFile(const std::string& filePath, bool mapped) {
+#if _WIN32
+    (void)mapped;
+    FILE* f = fileop::fopen(filePath, "rb");
+    if (!f) return false;
+    update(f);
+    bool ok = !ferror(f);
+    fileop::fclose(f);
+    return ok;
+#else
+    int fd;
+    if (fileop::open(filePath, fd, O_RDONLY)) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fileop::close(fd);
+        return false;
+    }
+    bool ok;
+    if (mapped && S_ISREG(st.st_mode) && st.st_size > 0) {
+        ok = updateMapped(this, fd, st.st_size, fileReadSize());
+    } else {
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        // Pipes, character devices, or files which report no size are read from the current position.
+        bool regular = S_ISREG(st.st_mode);
+        ok = updateRead(this, fd, regular ? 0 : -1, regular ? st.st_size : -1, fileReadSize());
+    }
+    fileop::close(fd);
+    return ok;
+#endif
+}
+
+bool Hash::updateFilePipelined(const std::string& filePath, size_t bufferSize, size_t queueDepth) {
+    if (!bufferSize) bufferSize = FILE_READ_CHUNK;
+    if (!queueDepth) queueDepth = 1;
+    FILE* f = fileop::fopen(filePath, "rb");
+    if (!f) return false;
+    // Buffers are large enough, let fread fill them directly.
+    setvbuf(f, nullptr, _IONBF, 0);
+    struct Slot {
+        std::vector<uint8_t> data;
+        size_t len = 0;
+    };
+    std::vector<Slot> slots(queueDepth + 1);
+    for (auto& slot : slots) slot.data.resize(bufferSize);
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t filled = 0;
+    bool eof = false, error = false;
+    // The slot being hashed stays counted in filled until it is released, so the reader can be queueDepth slots ahead.
+    std::thread reader([&]() {
+        size_t tail = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return filled < slots.size(); });
+            }
+            Slot& slot = slots[tail];
+            slot.len = fread(slot.data.data(), 1, bufferSize, f);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (slot.len > 0) {
+                filled++;
+                tail = (tail + 1) % slots.size();
+            }
+            if (slot.len < bufferSize) {
+                eof = true;
+                error = ferror(f);
+            }
+            cv.notify_all();
+            if (eof) break;
+        }
+    });
+    size_t head = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return filled > 0 || eof; });
+            if (!filled) break;
+        }
+        update(slots[head].data.data(), slots[head].len);
+        head = (head + 1) % slots.size();
+        std::lock_guard<std::mutex> lock(mutex);
+        filled--;
+        cv.notify_all();
+    }
+    reader.join();
+    fileop::fclose(f);
+    return !error;
+}
+
 Hash* Hash::finish(std::string& data) {
     return this->finish((uint8_t*)data.c_str(), data.size());
 }
@@ -54,16 +277,163 @@ std::vector<uint8_t> Hash::digest() {
 }
 
 std::string Hash::hexDigest() {
-    std::string hex;
     auto d = this->digest();
-    for (auto i : d) {
-        char buf[3];
-        snprintf(buf, sizeof(buf), "%02x", i);
-        hex += buf;
-    }
+    std::string hex(d.size() * 2, 0);
+    str_util::str_hex(d.data(), d.size(), &hex[0]);
     return hex;
 }
 
+bool Hash::hexDigest(char* output, size_t len) {
+    size_t digestLen = this->digestLength();
+    if (len < digestLen * 2 + 1) return false;
+    uint8_t buf[64];
+    if (digestLen <= sizeof(buf)) {
+        this->finish(buf, digestLen);
+        str_util::str_hex(buf, digestLen, output);
+    } else {
+        auto d = this->digest();
+        str_util::str_hex(d.data(), d.size(), output);
+    }
+    output[digestLen * 2] = 0;
+    return true;
+}
+
+#define HASH_STATE_VERSION 1
+#define HASH_STATE_SHA1 1
+#define HASH_STATE_SHA224 2
+#define HASH_STATE_SHA256 3
+#define HASH_STATE_SHA384 4
+#define HASH_STATE_SHA512 5
+#define HASH_STATE_SHA512_256 6
+#define HASH_STATE_MD5 7
+#define HASH_STATE_SHA3 8
+#define HASH_STATE_BLAKE3 9
+#define HASH_STATE_CRC32 10
+#define HASH_STATE_CRC32C 11
+#define HASH_STATE_XXH3_64 12
+#define HASH_STATE_XXH3_128 13
+
+/**
+ * Builds an exported state: "HS", version, algorithm, little endian fields, CRC-32C of everything before it
+ */
+struct StateWriter {
+    std::vector<uint8_t> data;
+    explicit StateWriter(uint8_t algorithm) {
+        data = { 'H', 'S', HASH_STATE_VERSION, algorithm };
+    }
+    void u8(uint8_t v) {
+        data.push_back(v);
+    }
+    void u32(uint32_t v) {
+        uint8_t b[4];
+        cstr_write_uint32(b, v, 0);
+        bytes(b, sizeof(b));
+    }
+    void u64(uint64_t v) {
+        uint8_t b[8];
+        cstr_write_uint64(b, v, 0);
+        bytes(b, sizeof(b));
+    }
+    void bytes(const uint8_t* p, size_t n) {
+        data.insert(data.end(), p, p + n);
+    }
+    std::vector<uint8_t> finish() {
+        CRC32C crc;
+        crc.update(data);
+        u32(crc.value());
+        return std::move(data);
+    }
+};
+
+/**
+ * Parses an exported state, ok is false once anything does not match
+ */
+struct StateReader {
+    const uint8_t* p = nullptr;
+    size_t left = 0;
+    bool ok = false;
+    StateReader(uint8_t algorithm, const uint8_t* data, size_t len) {
+        if (!data || len < 8 || data[0] != 'H' || data[1] != 'S' || data[2] != HASH_STATE_VERSION || data[3] != algorithm) return;
+        CRC32C crc;
+        crc.update(data, len - 4);
+        if (crc.value() != cstr_read_uint32(data + len - 4, 0)) return;
+        p = data + 4;
+        left = len - 8;
+        ok = true;
+    }
+    const uint8_t* bytes(size_t n) {
+        if (!ok || left < n) {
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t* re = p;
+        p += n;
+        left -= n;
+        return re;
+    }
+    uint8_t u8() {
+        const uint8_t* b = bytes(1);
+        return b ? *b : 0;
+    }
+    uint32_t u32() {
+        const uint8_t* b = bytes(4);
+        return b ? cstr_read_uint32(b, 0) : 0;
+    }
+    uint64_t u64() {
+        const uint8_t* b = bytes(8);
+        return b ? cstr_read_uint64(b, 0) : 0;
+    }
+    // Whole state consumed without errors
+    bool end() {
+        return ok && !left;
+    }
+};
+
+/**
+ * Export the state of a Merkle-Damgard hash, the buffered length is implied by the count of hashed bytes
+ */
+template<class W, size_t N>
+static std::vector<uint8_t> exportBlockState(uint8_t algorithm, const W(&state)[N], uint64_t bytesHashed, const uint8_t* buffer, size_t bufferLength) {
+    StateWriter w(algorithm);
+    for (size_t i = 0; i < N; i++) {
+        if (sizeof(W) == 8) w.u64(state[i]);
+        else w.u32((uint32_t)state[i]);
+    }
+    w.u64(bytesHashed);
+    w.bytes(buffer, bufferLength);
+    return w.finish();
+}
+
+template<class W, size_t N>
+static bool importBlockState(uint8_t algorithm, const uint8_t* data, size_t len, size_t blockSize, W(&state)[N], size_t& bytesHashed, uint8_t* buffer, size_t& bufferLength) {
+    StateReader r(algorithm, data, len);
+    W s[N];
+    for (size_t i = 0; i < N; i++) {
+        s[i] = sizeof(W) == 8 ? (W)r.u64() : (W)r.u32();
+    }
+    uint64_t total = r.u64();
+    size_t left = (size_t)(total % blockSize);
+    const uint8_t* b = r.bytes(left);
+    if (!r.end() || total > (size_t)-1) return false;
+    memcpy(state, s, sizeof(s));
+    bytesHashed = (size_t)total;
+    if (left) memcpy(buffer, b, left);
+    bufferLength = left;
+    return true;
+}
+
+std::vector<uint8_t> Hash::exportState() {
+    return {};
+}
+
+bool Hash::importState(const uint8_t*, size_t) {
+    return false;
+}
+
+bool Hash::importState(const std::vector<uint8_t>& data) {
+    return this->importState(data.data(), data.size());
+}
+
 SHA512::SHA512() {
     this->reset();
 }
@@ -86,261 +456,115 @@ Hash* SHA512::reset() {
 
 void SHA512::clean() {
     cleanBuffer(_buffer);
-    cleanBuffer(_tempHi);
-    cleanBuffer(_tempLo);
+    cleanBuffer(_temp);
     reset();
 }
 
+const uint64_t SHA512_IV[8] = {
+    0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+    0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+};
+
+const uint64_t SHA512_256_IV[8] = {
+    0x22312194fc2bf72c, 0x9f555fa3c84c64c2, 0x2393b86b6f53b151, 0x963877195940eabd,
+    0x96283ee2a88effe3, 0xbe5e1e2553863992, 0x2b0199fc2c85b8aa, 0x0eb72ddc81c52ca2
+};
+
+const uint64_t SHA384_IV[8] = {
+    0xcbbb9d5dc1059ed8, 0x629a292a367cd507, 0x9159015a3070dd17, 0x152fecd8f70e5939,
+    0x67332667ffc00b31, 0x8eb44a8768581511, 0xdb0c2e0d64f98fa7, 0x47b5481dbefa4fa4
+};
+
 void SHA512::_initState() {
-    stateHi[0] = 0x6a09e667;
-    stateHi[1] = 0xbb67ae85;
-    stateHi[2] = 0x3c6ef372;
-    stateHi[3] = 0xa54ff53a;
-    stateHi[4] = 0x510e527f;
-    stateHi[5] = 0x9b05688c;
-    stateHi[6] = 0x1f83d9ab;
-    stateHi[7] = 0x5be0cd19;
-    stateLo[0] = 0xf3bcc908;
-    stateLo[1] = 0x84caa73b;
-    stateLo[2] = 0xfe94f82b;
-    stateLo[3] = 0x5f1d36f1;
-    stateLo[4] = 0xade682d1;
-    stateLo[5] = 0x2b3e6c1f;
-    stateLo[6] = 0xfb41bd6b;
-    stateLo[7] = 0x137e2179;
-}
-
-const uint32_t SHA512_K[] = {
-    0x428a2f98, 0xd728ae22, 0x71374491, 0x23ef65cd,
-    0xb5c0fbcf, 0xec4d3b2f, 0xe9b5dba5, 0x8189dbbc,
-    0x3956c25b, 0xf348b538, 0x59f111f1, 0xb605d019,
-    0x923f82a4, 0xaf194f9b, 0xab1c5ed5, 0xda6d8118,
-    0xd807aa98, 0xa3030242, 0x12835b01, 0x45706fbe,
-    0x243185be, 0x4ee4b28c, 0x550c7dc3, 0xd5ffb4e2,
-    0x72be5d74, 0xf27b896f, 0x80deb1fe, 0x3b1696b1,
-    0x9bdc06a7, 0x25c71235, 0xc19bf174, 0xcf692694,
-    0xe49b69c1, 0x9ef14ad2, 0xefbe4786, 0x384f25e3,
-    0x0fc19dc6, 0x8b8cd5b5, 0x240ca1cc, 0x77ac9c65,
-    0x2de92c6f, 0x592b0275, 0x4a7484aa, 0x6ea6e483,
-    0x5cb0a9dc, 0xbd41fbd4, 0x76f988da, 0x831153b5,
-    0x983e5152, 0xee66dfab, 0xa831c66d, 0x2db43210,
-    0xb00327c8, 0x98fb213f, 0xbf597fc7, 0xbeef0ee4,
-    0xc6e00bf3, 0x3da88fc2, 0xd5a79147, 0x930aa725,
-    0x06ca6351, 0xe003826f, 0x14292967, 0x0a0e6e70,
-    0x27b70a85, 0x46d22ffc, 0x2e1b2138, 0x5c26c926,
-    0x4d2c6dfc, 0x5ac42aed, 0x53380d13, 0x9d95b3df,
-    0x650a7354, 0x8baf63de, 0x766a0abb, 0x3c77b2a8,
-    0x81c2c92e, 0x47edaee6, 0x92722c85, 0x1482353b,
-    0xa2bfe8a1, 0x4cf10364, 0xa81a664b, 0xbc423001,
-    0xc24b8b70, 0xd0f89791, 0xc76c51a3, 0x0654be30,
-    0xd192e819, 0xd6ef5218, 0xd6990624, 0x5565a910,
-    0xf40e3585, 0x5771202a, 0x106aa070, 0x32bbd1b8,
-    0x19a4c116, 0xb8d2d0c8, 0x1e376c08, 0x5141ab53,
-    0x2748774c, 0xdf8eeb99, 0x34b0bcb5, 0xe19b48a8,
-    0x391c0cb3, 0xc5c95a63, 0x4ed8aa4a, 0xe3418acb,
-    0x5b9cca4f, 0x7763e373, 0x682e6ff3, 0xd6b2b8a3,
-    0x748f82ee, 0x5defb2fc, 0x78a5636f, 0x43172f60,
-    0x84c87814, 0xa1f0ab72, 0x8cc70208, 0x1a6439ec,
-    0x90befffa, 0x23631e28, 0xa4506ceb, 0xde82bde9,
-    0xbef9a3f7, 0xb2c67915, 0xc67178f2, 0xe372532b,
-    0xca273ece, 0xea26619c, 0xd186b8c7, 0x21c0c207,
-    0xeada7dd6, 0xcde0eb1e, 0xf57d4f7f, 0xee6ed178,
-    0x06f067aa, 0x72176fba, 0x0a637dc5, 0xa2c898a6,
-    0x113f9804, 0xbef90dae, 0x1b710b35, 0x131c471b,
-    0x28db77f5, 0x23047d84, 0x32caab7b, 0x40c72493,
-    0x3c9ebe0a, 0x15c9bebc, 0x431d67c4, 0x9c100d4c,
-    0x4cc5d4be, 0xcb3e42b6, 0x597f299c, 0xfc657e2a,
-    0x5fcb6fab, 0x3ad6faec, 0x6c44198c, 0x4a475817
+    memcpy(state, SHA512_IV, sizeof(state));
+}
+
+const uint64_t hash_lib::internal::SHA512_K[80] = {
+    0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+    0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+    0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+    0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+    0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+    0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+    0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+    0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+    0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+    0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+    0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+    0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+    0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+    0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+    0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+    0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+    0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+    0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+    0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+    0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
 };
 
-#define SHA512_MACRO(num) \
-        h = ah##num; \
-        l = al##num; \
-        a = l & 0xffff; \
-        b = l >> 16; \
-        c = h & 0xffff; \
-        d = h >> 16; \
-        h = stateHi[num]; \
-        l = stateLo[num]; \
-        a += l & 0xffff; \
-        b += l >> 16; \
-        c += h & 0xffff; \
-        d += h >> 16; \
-        b += a >> 16; \
-        c += b >> 16; \
-        d += c >> 16; \
-        stateHi[num] = ah##num = (c & 0xffff) | (d << 16); \
-        stateLo[num] = al##num = (a & 0xffff) | (b << 16);
-
-size_t  SHA512::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
-    uint32_t ah0 = stateHi[0], ah1 = stateHi[1], ah2 = stateHi[2], ah3 = stateHi[3],
-             ah4 = stateHi[4], ah5 = stateHi[5], ah6 = stateHi[6], ah7 = stateHi[7],
-             al0 = stateLo[0], al1 = stateLo[1], al2 = stateLo[2], al3 = stateLo[3],
-             al4 = stateLo[4], al5 = stateLo[5], al6 = stateLo[6], al7 = stateLo[7];
-    uint32_t h, l;
-    uint32_t th, tl;
-    uint32_t a, b, c, d;
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+// wk[i * stride] holds W[i] + K[i] of the block.
+static inline void sha512Rounds(uint64_t state[8], const uint64_t* wk, size_t stride) {
+    uint64_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 80; i++) {
+        uint64_t t1 = (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + ((e & f) ^ (~e & g)) + h + wk[i * stride];
+        uint64_t t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static internal::SHA512ScheduleFunc sha512HardwareSchedule() {
+#if HASH_LIB_X86
+    if (cpu_util::has_avx2()) return internal::sha512ScheduleAvx2;
+#endif
+    return nullptr;
+}
+
+size_t SHA512::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
+    static const internal::SHA512ScheduleFunc schedule = sha512HardwareSchedule();
+    if (schedule && len >= 4 * SHA512_BLOCK_SIZE && internal::useHardware()) {
+        uint64_t wk[80 * 4];
+        while (len >= 4 * SHA512_BLOCK_SIZE) {
+            schedule(m + pos, wk);
+            for (int j = 0; j < 4; j++) {
+                sha512Rounds(state, wk + j, 4);
+            }
+            pos += 4 * SHA512_BLOCK_SIZE;
+            len -= 4 * SHA512_BLOCK_SIZE;
+        }
+    }
     while (len >= 128) {
         for (int i = 0; i < 16; i++) {
-            size_t j = i * 8 + pos;
-            _tempHi[i] = cstr_read_uint32(m + j, 1);
-            _tempLo[i] = cstr_read_uint32(m + j + 4, 1);
+            _temp[i] = cstr_read_uint64(m + i * 8 + pos, 1);
+        }
+        for (int i = 16; i < 80; i++) {
+            uint64_t u = _temp[i - 2];
+            uint64_t t1 = ROTR64(u, 19) ^ ROTR64(u, 61) ^ (u >> 6);
+            u = _temp[i - 15];
+            uint64_t t2 = ROTR64(u, 1) ^ ROTR64(u, 8) ^ (u >> 7);
+            _temp[i] = (t1 + _temp[i - 7]) + (t2 + _temp[i - 16]);
         }
         for (int i = 0; i < 80; i++) {
-            uint32_t bh0 = ah0, bh1 = ah1, bh2 = ah2, bh3 = ah3,
-                     bh4 = ah4, bh5 = ah5, bh6 = ah6, bh7 = ah7,
-                     bl0 = al0, bl1 = al1, bl2 = al2, bl3 = al3,
-                     bl4 = al4, bl5 = al5, bl6 = al6, bl7 = al7;
-            // add
-            h = ah7;
-            l = al7;
-            a = l & 0xffff;
-            b = l >> 16;
-            c = h & 0xffff;
-            d = h >> 16;
-            // Sigma1
-            h = ((ah4 >> 14) | (al4 << (32 - 14))) ^ ((ah4 >> 18) | (al4 << (32 - 18))) ^ ((al4 >> (41 - 32)) | (ah4 << (32 - (41 - 32))));
-            l = ((al4 >> 14) | (ah4 << (32 - 14))) ^ ((al4 >> 18) | (ah4 << (32 - 18))) ^ ((ah4 >> (41 - 32)) | (al4 << (32 - (41 - 32))));
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            // Ch
-            h = (ah4 & ah5) ^ (~ah4 & ah6);
-            l = (al4 & al5) ^ (~al4 & al6);
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            // K
-            h = SHA512_K[i * 2];
-            l = SHA512_K[i * 2 + 1];
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            // w
-            h = _tempHi[i % 16];
-            l = _tempLo[i % 16];
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            b += a >> 16;
-            c += b >> 16;
-            d += c >> 16;
-            th = c & 0xffff | (d << 16);
-            tl = a & 0xffff | (b << 16);
-            // add
-            h = th;
-            l = tl;
-            a = l & 0xffff;
-            b = l >> 16;
-            c = h & 0xffff;
-            d = h >> 16;
-            // Sigma0
-            h = ((ah0 >> 28) | (al0 << (32 - 28))) ^ ((al0 >> (34 - 32)) | (ah0 << (32 - (34 - 32)))) ^ ((al0 >> (39 - 32)) | (ah0 << (32 - (39 - 32))));
-            l = ((al0 >> 28) | (ah0 << (32 - 28))) ^ ((ah0 >> (34 - 32)) | (al0 << (32 - (34 - 32)))) ^ ((ah0 >> (39 - 32)) | (al0 << (32 - (39 - 32))));
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            // Maj
-            h = (ah0 & ah1) ^ (ah0 & ah2) ^ (ah1 & ah2);
-            l = (al0 & al1) ^ (al0 & al2) ^ (al1 & al2);
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            b += a >> 16;
-            c += b >> 16;
-            d += c >> 16;
-            bh7 = (c & 0xffff) | (d << 16);
-            bl7 = (a & 0xffff) | (b << 16);
-            // add
-            h = bh3;
-            l = bl3;
-            a = l & 0xffff;
-            b = l >> 16;
-            c = h & 0xffff;
-            d = h >> 16;
-            h = th;
-            l = tl;
-            a += l & 0xffff;
-            b += l >> 16;
-            c += h & 0xffff;
-            d += h >> 16;
-            b += a >> 16;
-            c += b >> 16;
-            d += c >> 16;
-            bh3 = (c & 0xffff) | (d << 16);
-            bl3 = (a & 0xffff) | (b << 16);
-            ah1 = bh0;
-            ah2 = bh1;
-            ah3 = bh2;
-            ah4 = bh3;
-            ah5 = bh4;
-            ah6 = bh5;
-            ah7 = bh6;
-            ah0 = bh7;
-            al1 = bl0;
-            al2 = bl1;
-            al3 = bl2;
-            al4 = bl3;
-            al5 = bl4;
-            al6 = bl5;
-            al7 = bl6;
-            al0 = bl7;
-            if (i % 16 == 15) {
-                for (int j = 0; j < 16; j++) {
-                    // add
-                    h = _tempHi[j];
-                    l = _tempLo[j];
-                    a = l & 0xffff;
-                    b = l >> 16;
-                    c = h & 0xffff;
-                    d = h >> 16;
-                    h = _tempHi[(j + 9) % 16];
-                    l = _tempLo[(j + 9) % 16];
-                    a += l & 0xffff;
-                    b += l >> 16;
-                    c += h & 0xffff;
-                    d += h >> 16;
-                    // sigma0
-                    th = _tempHi[(j + 1) % 16];
-                    tl = _tempLo[(j + 1) % 16];
-                    h = ((th >> 1) | (tl << (32 - 1))) ^ ((th >> 8) | (tl << (32 - 8))) ^ (th >> 7);
-                    l = ((tl >> 1) | (th << (32 - 1))) ^ ((tl >> 8) | (th << (32 - 8))) ^ ((tl >> 7) | (th << (32 - 7)));
-                    a += l & 0xffff;
-                    b += l >> 16;
-                    c += h & 0xffff;
-                    d += h >> 16;
-                    // sigma1
-                    th = _tempHi[(j + 14) % 16];
-                    tl = _tempLo[(j + 14) % 16];
-                    h = ((th >> 19) | (tl << (32 - 19))) ^ ((tl >> (61 - 32)) | (th << (32 - (61 - 32)))) ^ (th >> 6);
-                    l = ((tl >> 19) | (th << (32 - 19))) ^ ((th >> (61 - 32)) | (tl << (32 - (61 - 32)))) ^ ((tl >> 6) | (th << (32 - 6)));
-                    a += l & 0xffff;
-                    b += l >> 16;
-                    c += h & 0xffff;
-                    d += h >> 16;
-                    b += a >> 16;
-                    c += b >> 16;
-                    d += c >> 16;
-                    _tempHi[j] = (c & 0xffff) | (d << 16);
-                    _tempLo[j] = (a & 0xffff) | (b << 16);
-                }
-            }
+            _temp[i] += internal::SHA512_K[i];
         }
-        // add
-        SHA512_MACRO(0);
-        SHA512_MACRO(1);
-        SHA512_MACRO(2);
-        SHA512_MACRO(3);
-        SHA512_MACRO(4);
-        SHA512_MACRO(5);
-        SHA512_MACRO(6);
-        SHA512_MACRO(7);
+        sha512Rounds(state, _temp, 1);
         pos += 128;
         len -= 128;
     }
@@ -348,29 +572,11 @@ size_t  SHA512::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
 }
 
 Hash* SHA512::update(const uint8_t* data, size_t len) {
-    if (_finished) {
-        return this;
-    }
-    size_t dataPos = 0;
+    if (_finished) return this;
     _bytesHashed += len;
-    if (_bufferLength > 0) {
-        while (_bufferLength < SHA512_BLOCK_SIZE && len > 0) {
-            _buffer[_bufferLength++] = data[dataPos++];
-            len--;
-        }
-        if (_bufferLength == SHA512_BLOCK_SIZE) {
-            hashBlocks(_buffer, 0, SHA512_BLOCK_SIZE);
-            _bufferLength = 0;
-        }
-    }
-    if (len >= SHA512_BLOCK_SIZE) {
-        dataPos = hashBlocks(data, dataPos, len);
-        len %= SHA512_BLOCK_SIZE;
-    }
-    while (len > 0) {
-        _buffer[_bufferLength++] = data[dataPos++];
-        len--;
-    }
+    blockUpdate(_buffer, _bufferLength, SHA512_BLOCK_SIZE, data, len, [this](const uint8_t* m, size_t l) {
+        hashBlocks(m, 0, l);
+    });
     return this;
 }
 
@@ -387,12 +593,28 @@ Hash* SHA512::finish(uint8_t* data, size_t len) {
         _finished = true;
     }
     for (int i = 0; i < this->digestLength() / 8 && i < len / 8; i++) {
-        cstr_write_uint32(data + i * 8, stateHi[i], 1);
-        cstr_write_uint32(data + i * 8 + 4, stateLo[i], 1);
+        cstr_write_uint64(data + i * 8, state[i], 1);
     }
     return this;
 }
 
+static uint8_t sha512StateAlgorithm(int digestLength) {
+    if (digestLength == SHA384_DIGEST_LENGTH) return HASH_STATE_SHA384;
+    if (digestLength == SHA512_256_DIGEST_LENGTH) return HASH_STATE_SHA512_256;
+    return HASH_STATE_SHA512;
+}
+
+std::vector<uint8_t> SHA512::exportState() {
+    if (_finished) return {};
+    return exportBlockState(sha512StateAlgorithm(digestLength()), state, _bytesHashed, _buffer, _bufferLength);
+}
+
+bool SHA512::importState(const uint8_t* data, size_t len) {
+    if (!importBlockState(sha512StateAlgorithm(digestLength()), data, len, SHA512_BLOCK_SIZE, state, _bytesHashed, _buffer, _bufferLength)) return false;
+    _finished = false;
+    return true;
+}
+
 SHA512_256::SHA512_256() {
     this->reset();
 }
@@ -402,22 +624,7 @@ int SHA512_256::digestLength() {
 }
 
 void SHA512_256::_initState() {
-    stateHi[0] = 0x22312194;
-    stateHi[1] = 0x9f555fa3;
-    stateHi[2] = 0x2393b86b;
-    stateHi[3] = 0x96387719;
-    stateHi[4] = 0x96283ee2;
-    stateHi[5] = 0xbe5e1e25;
-    stateHi[6] = 0x2b0199fc;
-    stateHi[7] = 0x0eb72ddc;
-    stateLo[0] = 0xfc2bf72c;
-    stateLo[1] = 0xc84c64c2;
-    stateLo[2] = 0x6f53b151;
-    stateLo[3] = 0x5940eabd;
-    stateLo[4] = 0xa88effe3;
-    stateLo[5] = 0x53863992;
-    stateLo[6] = 0x2c85b8aa;
-    stateLo[7] = 0x81c52ca2;
+    memcpy(state, SHA512_256_IV, sizeof(state));
 }
 
 SHA384::SHA384() {
@@ -429,22 +636,7 @@ int SHA384::digestLength() {
 }
 
 void SHA384::_initState() {
-    stateHi[0] = 0xcbbb9d5d;
-    stateHi[1] = 0x629a292a;
-    stateHi[2] = 0x9159015a;
-    stateHi[3] = 0x152fecd8;
-    stateHi[4] = 0x67332667;
-    stateHi[5] = 0x8eb44a87;
-    stateHi[6] = 0xdb0c2e0d;
-    stateHi[7] = 0x47b5481d;
-    stateLo[0] = 0xc1059ed8;
-    stateLo[1] = 0x367cd507;
-    stateLo[2] = 0x3070dd17;
-    stateLo[3] = 0xf70e5939;
-    stateLo[4] = 0xffc00b31;
-    stateLo[5] = 0x68581511;
-    stateLo[6] = 0x64f98fa7;
-    stateLo[7] = 0xbefa4fa4;
+    memcpy(state, SHA384_IV, sizeof(state));
 }
 
 SHA256::SHA256() {
@@ -459,15 +651,18 @@ int SHA256::blockSize() {
     return SHA256_BLOCK_SIZE; // SHA-256 processes data in 512-bit blocks (64 bytes)
 }
 
+const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t SHA224_IV[8] = {
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+    0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+
 void SHA256::_initState() {
-    state[0] = 0x6a09e667;
-    state[1] = 0xbb67ae85;
-    state[2] = 0x3c6ef372;
-    state[3] = 0xa54ff53a;
-    state[4] = 0x510e527f;
-    state[5] = 0x9b05688c;
-    state[6] = 0x1f83d9ab;
-    state[7] = 0x5be0cd19;
+    memcpy(state, SHA256_IV, sizeof(state));
 }
 
 Hash* SHA256::reset() {
@@ -486,26 +681,10 @@ void SHA256::clean() {
 
 Hash* SHA256::update(const uint8_t* data, size_t len) {
     if (_finished) return this;
-    size_t dataPos = 0;
     _bytesHashed += len;
-    if (_bufferLength > 0) {
-        while (_bufferLength < SHA256_BLOCK_SIZE && len > 0) {
-            _buffer[_bufferLength++] = data[dataPos++];
-            len--;
-        }
-        if (_bufferLength == SHA256_BLOCK_SIZE) {
-            hashBlocks(_buffer, 0, SHA256_BLOCK_SIZE);
-            _bufferLength = 0;
-        }
-    }
-    if (len >= SHA256_BLOCK_SIZE) {
-        dataPos = hashBlocks(data, dataPos, len);
-        len %= SHA256_BLOCK_SIZE;
-    }
-    while (len > 0) {
-        _buffer[_bufferLength++] = data[dataPos++];
-        len--;
-    }
+    blockUpdate(_buffer, _bufferLength, SHA256_BLOCK_SIZE, data, len, [this](const uint8_t* m, size_t l) {
+        hashBlocks(m, 0, l);
+    });
     return this;
 }
 
@@ -527,7 +706,20 @@ Hash* SHA256::finish(uint8_t* data, size_t len) {
     return this;
 }
 
-const uint32_t SHA256_K[] = {
+std::vector<uint8_t> SHA256::exportState() {
+    if (_finished) return {};
+    uint8_t algorithm = digestLength() == SHA224_DIGEST_LENGTH ? HASH_STATE_SHA224 : HASH_STATE_SHA256;
+    return exportBlockState(algorithm, state, _bytesHashed, _buffer, _bufferLength);
+}
+
+bool SHA256::importState(const uint8_t* data, size_t len) {
+    uint8_t algorithm = digestLength() == SHA224_DIGEST_LENGTH ? HASH_STATE_SHA224 : HASH_STATE_SHA256;
+    if (!importBlockState(algorithm, data, len, SHA256_BLOCK_SIZE, state, _bytesHashed, _buffer, _bufferLength)) return false;
+    _finished = false;
+    return true;
+}
+
+const uint32_t hash_lib::internal::SHA256_K[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
     0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
     0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
@@ -543,7 +735,24 @@ const uint32_t SHA256_K[] = {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+static internal::SHA256BlocksFunc sha256HardwareBlocks() {
+#if HASH_LIB_X86
+    if (cpu_util::has_x86_sha()) return internal::sha256BlocksShaNi;
+#endif
+#if HASH_LIB_ARM_CRYPTO
+    if (cpu_util::has_arm_sha2()) return internal::sha256BlocksArm;
+#endif
+    return nullptr;
+}
+
 size_t SHA256::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
+    // Selected once, falls back to the portable loop below when no SHA instructions are available.
+    static const internal::SHA256BlocksFunc hardwareBlocks = sha256HardwareBlocks();
+    if (hardwareBlocks && len >= 64 && internal::useHardware()) {
+        size_t blocks = len / 64;
+        hardwareBlocks(state, m + pos, blocks);
+        return pos + blocks * 64;
+    }
     while (len >= 64) {
         uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
                  e = state[4], f = state[5], g = state[6], h = state[7];
@@ -559,7 +768,7 @@ size_t SHA256::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
             _temp[i] = (t1 + _temp[i - 7]) + (t2 + _temp[i - 16]);
         }
         for (int i = 0; i < 64; i++) {
-            uint32_t t1 = ((e >> 6 | e << (32 - 6)) ^ (e >> 11 | e << (32 - 11)) ^ (e >> 25 | e << (32 - 25))) + ((e & f) ^ (~e & g)) + h + SHA256_K[i] + _temp[i];
+            uint32_t t1 = ((e >> 6 | e << (32 - 6)) ^ (e >> 11 | e << (32 - 11)) ^ (e >> 25 | e << (32 - 25))) + ((e & f) ^ (~e & g)) + h + internal::SHA256_K[i] + _temp[i];
             uint32_t t2 = ((a >> 2 | a << (32 - 2)) ^ (a >> 13 | a << (32 - 13)) ^ (a >> 22 | a << (32 - 22))) + ((a & b) ^ (a & c) ^ (b & c));
             h = g;
             g = f;
@@ -593,14 +802,147 @@ int SHA224::digestLength() {
 }
 
 void SHA224::_initState() {
-    state[0] = 0xc1059ed8;
-    state[1] = 0x367cd507;
-    state[2] = 0x3070dd17;
-    state[3] = 0xf70e5939;
-    state[4] = 0xffc00b31;
-    state[5] = 0x68581511;
-    state[6] = 0x64f98fa7;
-    state[7] = 0xbefa4fa4;
+    memcpy(state, SHA224_IV, sizeof(state));
+}
+
+struct SHA256MultiBuffer {
+    internal::SHA256MultiBlocksFunc blocks = nullptr;
+    size_t lanes = 0;
+};
+
+static SHA256MultiBuffer sha256MultiBuffer() {
+    SHA256MultiBuffer re;
+#if HASH_LIB_X86
+    if (cpu_util::has_avx512f()) {
+        re.blocks = internal::sha256MultiBlocksAvx512;
+        re.lanes = 16;
+    } else if (cpu_util::has_avx2() && !cpu_util::has_x86_sha()) {
+        // 8 AVX2 lanes are not faster than SHA-NI hashing the messages one by one.
+        re.blocks = internal::sha256MultiBlocksAvx2;
+        re.lanes = 8;
+    }
+#endif
+    return re;
+}
+
+struct BatchLane {
+    const uint8_t* m;
+    size_t blocks;
+    size_t index;
+    bool active;
+    bool tail;
+    uint8_t tailBuffer[168];
+    size_t tailBlocks;
+};
+
+/**
+ * Hashes count messages on a multi-buffer kernel, feeding a new message to each lane as soon as its previous one is done.
+ * @param blockSize the block size of the hash, at most 168 bytes
+ * @param tail builds the padded last blocks of a message into a tail buffer and returns the number of blocks written
+ * @param start resets the state of a lane before it is fed a new message
+ * @param run runs the kernel on all lanes for the given number of blocks
+ * @param finish writes the digest of the message with the given index from the state of a lane
+ */
+template <typename Tail, typename Start, typename Run, typename Finish>
+static void batchLanes(const uint8_t* const* data, const size_t* lens, size_t count, size_t lanes, size_t blockSize,
+                       Tail tail, Start start, Run run, Finish finish) {
+    BatchLane lane[16];
+    const uint8_t* m[16];
+    size_t next = 0, done = 0;
+    for (size_t j = 0; j < lanes; j++) {
+        lane[j].active = false;
+    }
+    while (done < count) {
+        // Feed idle lanes with the next messages
+        for (size_t j = 0; j < lanes && next < count; j++) {
+            if (lane[j].active) continue;
+            BatchLane& l = lane[j];
+            size_t len = lens[next];
+            l.m = data[next];
+            l.blocks = len / blockSize;
+            l.index = next++;
+            l.active = true;
+            l.tail = false;
+            l.tailBlocks = tail(l.tailBuffer, l.m, len);
+            if (!l.blocks) {
+                l.m = l.tailBuffer;
+                l.blocks = l.tailBlocks;
+                l.tail = true;
+            }
+            start(j);
+        }
+        // Run all lanes until the first one runs out of blocks
+        size_t blocks = (size_t)-1;
+        const uint8_t* any = nullptr;
+        for (size_t j = 0; j < lanes; j++) {
+            if (!lane[j].active) continue;
+            if (lane[j].blocks < blocks) blocks = lane[j].blocks;
+            any = lane[j].m;
+        }
+        for (size_t j = 0; j < lanes; j++) {
+            // Idle lanes hash a copy of an active lane, their result is discarded.
+            m[j] = lane[j].active ? lane[j].m : any;
+        }
+        run(m, blocks);
+        for (size_t j = 0; j < lanes; j++) {
+            BatchLane& l = lane[j];
+            if (!l.active) continue;
+            l.m += blocks * blockSize;
+            l.blocks -= blocks;
+            if (l.blocks) continue;
+            if (!l.tail) {
+                l.m = l.tailBuffer;
+                l.blocks = l.tailBlocks;
+                l.tail = true;
+                continue;
+            }
+            finish(j, l.index);
+            l.active = false;
+            done++;
+        }
+    }
+}
+
+void hash_lib::internal::sha256Batch(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, bool sha224) {
+    static const SHA256MultiBuffer engine = sha256MultiBuffer();
+    size_t digestLength = sha224 ? SHA224_DIGEST_LENGTH : SHA256_DIGEST_LENGTH;
+    if (!engine.blocks || count < 2 || !useHardware()) {
+        SHA256 sha256;
+        SHA224 sha224Hash;
+        Hash& h = sha224 ? (Hash&)sha224Hash : (Hash&)sha256;
+        for (size_t i = 0; i < count; i++) {
+            h.reset();
+            h.update(data[i], lens[i])->finish(out + i * digestLength, digestLength);
+        }
+        return;
+    }
+    const uint32_t* iv = sha224 ? SHA224_IV : SHA256_IV;
+    const size_t lanes = engine.lanes;
+    uint32_t state[8 * 16] = {};
+    batchLanes(data, lens, count, lanes, SHA256_BLOCK_SIZE,
+        [](uint8_t* buffer, const uint8_t* m, size_t len) {
+            size_t left = len % SHA256_BLOCK_SIZE;
+            size_t blocks = left < 56 ? 1 : 2;
+            if (left) memcpy(buffer, m + len - left, left);
+            buffer[left] = 0x80;
+            memset(buffer + left + 1, 0, blocks * SHA256_BLOCK_SIZE - left - 9);
+            cstr_write_uint64(buffer + blocks * SHA256_BLOCK_SIZE - 8, (uint64_t)len << 3, 1);
+            return blocks;
+        },
+        [&](size_t j) {
+            for (int i = 0; i < 8; i++) {
+                state[i * lanes + j] = iv[i];
+            }
+        },
+        [&](const uint8_t** m, size_t blocks) {
+            engine.blocks(state, m, blocks);
+        },
+        [&](size_t j, size_t index) {
+            uint8_t* o = out + index * digestLength;
+            for (size_t i = 0; i < digestLength / 4; i++) {
+                cstr_write_uint32(o + i * 4, state[i * lanes + j], 1);
+            }
+        });
 }
 
 SHA1::SHA1() {
@@ -639,26 +981,10 @@ void SHA1::clean() {
 
 Hash* SHA1::update(const uint8_t* data, size_t len) {
     if (_finished) return this;
-    size_t dataPos = 0;
     _bytesHashed += len;
-    if (_bufferLength > 0) {
-        while (_bufferLength < SHA1_BLOCK_SIZE && len > 0) {
-            _buffer[_bufferLength++] = data[dataPos++];
-            len--;
-        }
-        if (_bufferLength == SHA1_BLOCK_SIZE) {
-            hashBlocks(_buffer, 0, SHA1_BLOCK_SIZE);
-            _bufferLength = 0;
-        }
-    }
-    if (len >= SHA1_BLOCK_SIZE) {
-        dataPos = hashBlocks(data, dataPos, len);
-        len %= SHA1_BLOCK_SIZE;
-    }
-    while (len > 0) {
-        _buffer[_bufferLength++] = data[dataPos++];
-        len--;
-    }
+    blockUpdate(_buffer, _bufferLength, SHA1_BLOCK_SIZE, data, len, [this](const uint8_t* m, size_t l) {
+        hashBlocks(m, 0, l);
+    });
     return this;
 }
 
@@ -680,7 +1006,34 @@ Hash* SHA1::finish(uint8_t* data, size_t len) {
     return this;
 }
 
+std::vector<uint8_t> SHA1::exportState() {
+    if (_finished) return {};
+    return exportBlockState(HASH_STATE_SHA1, state, _bytesHashed, _buffer, _bufferLength);
+}
+
+bool SHA1::importState(const uint8_t* data, size_t len) {
+    if (!importBlockState(HASH_STATE_SHA1, data, len, SHA1_BLOCK_SIZE, state, _bytesHashed, _buffer, _bufferLength)) return false;
+    _finished = false;
+    return true;
+}
+
+static internal::SHA1BlocksFunc sha1HardwareBlocks() {
+#if HASH_LIB_X86
+    if (cpu_util::has_x86_sha()) return internal::sha1BlocksShaNi;
+#endif
+#if HASH_LIB_ARM_CRYPTO
+    if (cpu_util::has_arm_sha1()) return internal::sha1BlocksArm;
+#endif
+    return nullptr;
+}
+
 size_t SHA1::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
+    static const internal::SHA1BlocksFunc hardwareBlocks = sha1HardwareBlocks();
+    if (hardwareBlocks && len >= 64 && internal::useHardware()) {
+        size_t blocks = len / 64;
+        hardwareBlocks(state, m + pos, blocks);
+        return pos + blocks * 64;
+    }
     while (len >= 64) {
         for (int i = 0; i < 16; i++) {
             size_t j = i * 4 + pos;
@@ -759,26 +1112,10 @@ void MD5::clean() {
 
 Hash* MD5::update(const uint8_t* data, size_t len) {
     if (_finished) return this;
-    size_t dataPos = 0;
     _bytesHashed += len;
-    if (_bufferLength > 0) {
-        while (_bufferLength < MD5_BLOCK_SIZE && len > 0) {
-            _buffer[_bufferLength++] = data[dataPos++];
-            len--;
-        }
-        if (_bufferLength == MD5_BLOCK_SIZE) {
-            hashBlocks(_buffer, 0, MD5_BLOCK_SIZE);
-            _bufferLength = 0;
-        }
-    }
-    if (len >= MD5_BLOCK_SIZE) {
-        dataPos = hashBlocks(data, dataPos, len);
-        len %= MD5_BLOCK_SIZE;
-    }
-    while (len > 0) {
-        _buffer[_bufferLength++] = data[dataPos++];
-        len--;
-    }
+    blockUpdate(_buffer, _bufferLength, MD5_BLOCK_SIZE, data, len, [this](const uint8_t* m, size_t l) {
+        hashBlocks(m, 0, l);
+    });
     return this;
 }
 
@@ -800,6 +1137,17 @@ Hash* MD5::finish(uint8_t* data, size_t len) {
     return this;
 }
 
+std::vector<uint8_t> MD5::exportState() {
+    if (_finished) return {};
+    return exportBlockState(HASH_STATE_MD5, state, _bytesHashed, _buffer, _bufferLength);
+}
+
+bool MD5::importState(const uint8_t* data, size_t len) {
+    if (!importBlockState(HASH_STATE_MD5, data, len, MD5_BLOCK_SIZE, state, _bytesHashed, _buffer, _bufferLength)) return false;
+    _finished = false;
+    return true;
+}
+
 const uint8_t MD5_s[] = {
     7, 12, 17, 22,  7, 12, 17, 22,  7, 12, 17, 22,  7, 12, 17, 22,
     5,  9, 14, 20,  5,  9, 14, 20,  5,  9, 14, 20,  5,  9, 14, 20,
@@ -857,3 +1205,1959 @@ size_t MD5::hashBlocks(const uint8_t* m, size_t pos, size_t len) {
     }
     return pos;
 }
+
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_MAX_SIMD_DEGREE 16
+#define BLAKE3_CHUNK_START 1
+#define BLAKE3_CHUNK_END 2
+#define BLAKE3_PARENT 4
+#define BLAKE3_ROOT 8
+// Each thread hashes at least this many bytes in parallel mode
+#define BLAKE3_PARALLEL_MIN (128 * 1024)
+#define BLAKE3_FILE_READ_THREADED (16 << 20)
+
+const uint32_t hash_lib::internal::BLAKE3_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint8_t hash_lib::internal::BLAKE3_MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+#define BLAKE3_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define BLAKE3_G(a, b, c, d, x, y) \
+        v[a] = v[a] + v[b] + (x); \
+        v[d] = BLAKE3_ROTR(v[d] ^ v[a], 16); \
+        v[c] = v[c] + v[d]; \
+        v[b] = BLAKE3_ROTR(v[b] ^ v[c], 12); \
+        v[a] = v[a] + v[b] + (y); \
+        v[d] = BLAKE3_ROTR(v[d] ^ v[a], 8); \
+        v[c] = v[c] + v[d]; \
+        v[b] = BLAKE3_ROTR(v[b] ^ v[c], 7);
+
+static void blake3Compress(const uint32_t cv[8], const uint8_t block[64], uint8_t blockLen, uint64_t counter, uint8_t flags, uint32_t out[16]) {
+    uint32_t m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = cstr_read_uint32(block + i * 4, 0);
+    }
+    for (int i = 0; i < 8; i++) v[i] = cv[i];
+    for (int i = 0; i < 4; i++) v[8 + i] = internal::BLAKE3_IV[i];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = blockLen;
+    v[15] = flags;
+    for (int r = 0; r < 7; r++) {
+        const uint8_t* s = internal::BLAKE3_MSG_SCHEDULE[r];
+        BLAKE3_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        BLAKE3_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        BLAKE3_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        BLAKE3_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        BLAKE3_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        BLAKE3_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        BLAKE3_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        BLAKE3_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+}
+
+static void blake3HashOne(const uint8_t* input, size_t blocks, const uint32_t key[8], uint64_t counter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t out[32]) {
+    uint32_t cv[8], o[16];
+    memcpy(cv, key, sizeof(cv));
+    uint8_t blockFlags = flags | flagsStart;
+    for (size_t block = 0; block < blocks; block++) {
+        if (block + 1 == blocks) blockFlags |= flagsEnd;
+        blake3Compress(cv, input + block * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, blockFlags, o);
+        memcpy(cv, o, sizeof(cv));
+        blockFlags = flags;
+    }
+    for (int i = 0; i < 8; i++) {
+        cstr_write_uint32(out + i * 4, cv[i], 0);
+    }
+}
+
+struct BLAKE3HashMany {
+    internal::BLAKE3HashManyFunc wide = nullptr;
+    size_t wideLanes = 0;
+    internal::BLAKE3HashManyFunc narrow = nullptr;
+    size_t narrowLanes = 0;
+};
+
+static BLAKE3HashMany blake3HashMany() {
+    BLAKE3HashMany re;
+#if HASH_LIB_X86
+    if (cpu_util::has_avx2()) {
+        re.narrow = internal::blake3HashManyAvx2;
+        re.narrowLanes = 8;
+    }
+    if (cpu_util::has_avx512f()) {
+        re.wide = internal::blake3HashManyAvx512;
+        re.wideLanes = 16;
+    }
+#endif
+    return re;
+}
+
+static const BLAKE3HashMany& blake3Engine() {
+    static const BLAKE3HashMany engine = blake3HashMany();
+    return engine;
+}
+
+/**
+ * Count of chunks compressed at once by blake3HashManyDispatch, always a power of 2
+ */
+static size_t blake3SimdDegree() {
+    if (!internal::useHardware()) return 1;
+    auto& engine = blake3Engine();
+    if (engine.wide) return engine.wideLanes;
+    if (engine.narrow) return engine.narrowLanes;
+    return 1;
+}
+
+static void blake3HashManyDispatch(const uint8_t* const* inputs, size_t count, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out) {
+    if (internal::useHardware()) {
+        auto& engine = blake3Engine();
+        if (engine.wide) {
+            while (count >= engine.wideLanes) {
+                engine.wide(inputs, blocks, key, counter, incrementCounter, flags, flagsStart, flagsEnd, out);
+                inputs += engine.wideLanes;
+                count -= engine.wideLanes;
+                if (incrementCounter) counter += engine.wideLanes;
+                out += engine.wideLanes * BLAKE3_OUT_LEN;
+            }
+        }
+        if (engine.narrow) {
+            while (count >= engine.narrowLanes) {
+                engine.narrow(inputs, blocks, key, counter, incrementCounter, flags, flagsStart, flagsEnd, out);
+                inputs += engine.narrowLanes;
+                count -= engine.narrowLanes;
+                if (incrementCounter) counter += engine.narrowLanes;
+                out += engine.narrowLanes * BLAKE3_OUT_LEN;
+            }
+        }
+    }
+    while (count > 0) {
+        blake3HashOne(*inputs, blocks, key, counter, flags, flagsStart, flagsEnd, out);
+        inputs++;
+        count--;
+        if (incrementCounter) counter++;
+        out += BLAKE3_OUT_LEN;
+    }
+}
+
+struct BLAKE3Output {
+    uint32_t cv[8];
+    uint8_t block[64];
+    uint8_t blockLen;
+    uint64_t counter;
+    uint8_t flags;
+
+    void chainingValue(uint8_t out[32]) const {
+        uint32_t o[16];
+        blake3Compress(cv, block, blockLen, counter, flags, o);
+        for (int i = 0; i < 8; i++) {
+            cstr_write_uint32(out + i * 4, o[i], 0);
+        }
+    }
+
+    void rootBytes(uint8_t* out, size_t len) const {
+        uint32_t o[16];
+        uint8_t bytes[64];
+        for (uint64_t outputCounter = 0; len > 0; outputCounter++) {
+            blake3Compress(cv, block, blockLen, outputCounter, flags | BLAKE3_ROOT, o);
+            for (int i = 0; i < 16; i++) {
+                cstr_write_uint32(bytes + i * 4, o[i], 0);
+            }
+            size_t n = len < sizeof(bytes) ? len : sizeof(bytes);
+            memcpy(out, bytes, n);
+            out += n;
+            len -= n;
+        }
+    }
+};
+
+static BLAKE3Output blake3ParentOutput(const uint8_t left[32], const uint8_t right[32], const uint32_t key[8], uint8_t flags) {
+    BLAKE3Output re;
+    memcpy(re.cv, key, sizeof(re.cv));
+    memcpy(re.block, left, 32);
+    memcpy(re.block + 32, right, 32);
+    re.blockLen = BLAKE3_BLOCK_LEN;
+    re.counter = 0;
+    re.flags = flags | BLAKE3_PARENT;
+    return re;
+}
+
+static size_t largestPowerOfTwoLeq(uint64_t n) {
+    uint64_t re = 1;
+    while (re <= n / 2) re <<= 1;
+    return (size_t)re;
+}
+
+static unsigned int popCount(uint64_t n) {
+    unsigned int re = 0;
+    for (; n; n &= n - 1) re++;
+    return re;
+}
+
+/**
+ * Compress whole chunks and an optional partial chunk at the end
+ * @return Count of chaining values written to out
+ */
+static size_t blake3CompressChunks(const uint8_t* input, size_t len, const uint32_t key[8], uint64_t counter, uint8_t flags, uint8_t* out) {
+    const uint8_t* chunks[BLAKE3_MAX_SIMD_DEGREE];
+    size_t count = 0;
+    while (len - count * BLAKE3_CHUNK_LEN >= BLAKE3_CHUNK_LEN) {
+        chunks[count] = input + count * BLAKE3_CHUNK_LEN;
+        count++;
+    }
+    blake3HashManyDispatch(chunks, count, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, key, counter, true, flags, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, out);
+    size_t left = len - count * BLAKE3_CHUNK_LEN;
+    if (left > 0) {
+        // Partial chunk, it is never the root here since there are more chunks before it.
+        const uint8_t* p = input + count * BLAKE3_CHUNK_LEN;
+        BLAKE3Output o;
+        memcpy(o.cv, key, sizeof(o.cv));
+        uint8_t blockFlags = flags | BLAKE3_CHUNK_START;
+        uint32_t words[16];
+        while (left > BLAKE3_BLOCK_LEN) {
+            blake3Compress(o.cv, p, BLAKE3_BLOCK_LEN, counter + count, blockFlags, words);
+            memcpy(o.cv, words, sizeof(o.cv));
+            blockFlags = flags;
+            p += BLAKE3_BLOCK_LEN;
+            left -= BLAKE3_BLOCK_LEN;
+        }
+        memset(o.block, 0, sizeof(o.block));
+        memcpy(o.block, p, left);
+        o.blockLen = (uint8_t)left;
+        o.counter = counter + count;
+        o.flags = blockFlags | BLAKE3_CHUNK_END;
+        o.chainingValue(out + count * BLAKE3_OUT_LEN);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Compress pairs of chaining values into parents, an odd one at the end is copied as is
+ * @return Count of chaining values written to out
+ */
+static size_t blake3CompressParents(const uint8_t* cvs, size_t count, const uint32_t key[8], uint8_t flags, uint8_t* out) {
+    const uint8_t* parents[BLAKE3_MAX_SIMD_DEGREE];
+    size_t n = 0;
+    while (count - n * 2 >= 2) {
+        parents[n] = cvs + n * 2 * BLAKE3_OUT_LEN;
+        n++;
+    }
+    blake3HashManyDispatch(parents, n, 1, key, 0, false, flags | BLAKE3_PARENT, 0, 0, out);
+    if (count > n * 2) {
+        memcpy(out + n * BLAKE3_OUT_LEN, cvs + n * 2 * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+        return n + 1;
+    }
+    return n;
+}
+
+/**
+ * Compress a subtree of at least one chunk down to at most max(simd degree, 2) chaining values.
+ * @return Count of chaining values written to out, at least 2 if there is more than one chunk
+ */
+static size_t blake3CompressSubtreeWide(const uint8_t* input, size_t len, const uint32_t key[8], uint64_t counter, uint8_t flags, uint8_t* out) {
+    size_t degree = blake3SimdDegree();
+    if (len <= degree * BLAKE3_CHUNK_LEN) {
+        return blake3CompressChunks(input, len, key, counter, flags, out);
+    }
+    // The left subtree holds the largest power of 2 count of chunks, and it is never empty.
+    size_t leftLen = largestPowerOfTwoLeq((len - 1) / BLAKE3_CHUNK_LEN) * BLAKE3_CHUNK_LEN;
+    uint64_t rightCounter = counter + leftLen / BLAKE3_CHUNK_LEN;
+    uint8_t cvs[2 * BLAKE3_MAX_SIMD_DEGREE * BLAKE3_OUT_LEN];
+    size_t leftDegree = leftLen == BLAKE3_CHUNK_LEN ? 1 : (degree > 2 ? degree : 2);
+    size_t leftCount = blake3CompressSubtreeWide(input, leftLen, key, counter, flags, cvs);
+    size_t rightCount = blake3CompressSubtreeWide(input + leftLen, len - leftLen, key, rightCounter, flags, cvs + leftDegree * BLAKE3_OUT_LEN);
+    if (leftCount == 1) {
+        // Without SIMD both sides are single chunks, keep them apart so there are always 2 outputs.
+        memcpy(out, cvs, 2 * BLAKE3_OUT_LEN);
+        return 2;
+    }
+    return blake3CompressParents(cvs, leftCount + rightCount, key, flags, out);
+}
+
+/**
+ * Compress a complete subtree (a power of 2 count of chunks, more than one) down to the 2 children of its root.
+ * With threads, it is split into equal complete subtrees hashed on the worker pool of parallelFor.
+ */
+static void blake3CompressSubtreeToParentNode(const uint8_t* input, size_t len, const uint32_t key[8], uint64_t counter, uint8_t flags, unsigned int threads, uint8_t out[64]) {
+    size_t parts = 1;
+    while (parts * 2 <= threads && len / (parts * 2) >= BLAKE3_PARALLEL_MIN) parts *= 2;
+    if (parts > 1) {
+        size_t partLen = len / parts;
+        std::vector<uint8_t> cvs(parts * BLAKE3_OUT_LEN);
+        internal::parallelFor(parts, (unsigned int)parts, [&](size_t i) {
+            uint8_t pair[2 * BLAKE3_OUT_LEN];
+            blake3CompressSubtreeToParentNode(input + i * partLen, partLen, key, counter + i * (partLen / BLAKE3_CHUNK_LEN), flags, 1, pair);
+            blake3ParentOutput(pair, pair + BLAKE3_OUT_LEN, key, flags).chainingValue(cvs.data() + i * BLAKE3_OUT_LEN);
+        });
+        // The roots of the parts are the nodes of a complete tree, merge them up to the 2 children of the root
+        while (parts > 2) {
+            parts /= 2;
+            for (size_t i = 0; i < parts; i++) {
+                uint8_t* pair = cvs.data() + i * 2 * BLAKE3_OUT_LEN;
+                blake3ParentOutput(pair, pair + BLAKE3_OUT_LEN, key, flags).chainingValue(cvs.data() + i * BLAKE3_OUT_LEN);
+            }
+        }
+        memcpy(out, cvs.data(), 2 * BLAKE3_OUT_LEN);
+        return;
+    }
+    uint8_t cvs[BLAKE3_MAX_SIMD_DEGREE * BLAKE3_OUT_LEN];
+    uint8_t tmp[BLAKE3_MAX_SIMD_DEGREE / 2 * BLAKE3_OUT_LEN];
+    size_t count = blake3CompressSubtreeWide(input, len, key, counter, flags, cvs);
+    while (count > 2) {
+        count = blake3CompressParents(cvs, count, key, flags, tmp);
+        memcpy(cvs, tmp, count * BLAKE3_OUT_LEN);
+    }
+    memcpy(out, cvs, 2 * BLAKE3_OUT_LEN);
+}
+
+BLAKE3::BLAKE3() {
+    this->reset();
+}
+
+BLAKE3::BLAKE3(unsigned int threads) {
+    this->setThreads(threads);
+    this->reset();
+}
+
+int BLAKE3::digestLength() {
+    return BLAKE3_OUT_LEN;
+}
+
+int BLAKE3::blockSize() {
+    return BLAKE3_BLOCK_LEN;
+}
+
+size_t BLAKE3::fileReadSize() {
+    // Reads large enough to be split across the threads, unless they would only share a single core
+    static const unsigned int cores = std::thread::hardware_concurrency();
+    return _threads > 1 && cores != 1 ? BLAKE3_FILE_READ_THREADED : FILE_READ_CHUNK;
+}
+
+BLAKE3* BLAKE3::setThreads(unsigned int threads) {
+    if (!threads) threads = std::thread::hardware_concurrency();
+    _threads = threads ? threads : 1;
+    return this;
+}
+
+Hash* BLAKE3::reset() {
+    memcpy(_key, internal::BLAKE3_IV, sizeof(_key));
+    _flags = 0;
+    _cvStackLength = 0;
+    chunkReset(0);
+    _finished = false;
+    return this;
+}
+
+void BLAKE3::clean() {
+    cleanBuffer(_cvStack);
+    cleanBuffer(_buffer);
+    reset();
+}
+
+size_t BLAKE3::chunkLength() {
+    return _blocksCompressed * BLAKE3_BLOCK_LEN + _bufferLength;
+}
+
+void BLAKE3::chunkReset(uint64_t counter) {
+    memcpy(_chunkCv, _key, sizeof(_chunkCv));
+    _chunkCounter = counter;
+    _bufferLength = 0;
+    _blocksCompressed = 0;
+}
+
+void BLAKE3::chunkUpdate(const uint8_t* data, size_t len) {
+    uint32_t o[16];
+    while (len > 0) {
+        // The last block of the chunk stays in the buffer since it needs CHUNK_END.
+        if (_bufferLength == BLAKE3_BLOCK_LEN) {
+            blake3Compress(_chunkCv, _buffer, BLAKE3_BLOCK_LEN, _chunkCounter, _flags | (_blocksCompressed ? 0 : BLAKE3_CHUNK_START), o);
+            memcpy(_chunkCv, o, sizeof(_chunkCv));
+            _blocksCompressed++;
+            _bufferLength = 0;
+        }
+        size_t n = BLAKE3_BLOCK_LEN - _bufferLength < len ? BLAKE3_BLOCK_LEN - _bufferLength : len;
+        memcpy(_buffer + _bufferLength, data, n);
+        _bufferLength += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void BLAKE3::mergeCvStack(uint64_t totalChunks) {
+    size_t postMergeLength = popCount(totalChunks);
+    while (_cvStackLength > postMergeLength) {
+        uint8_t* left = _cvStack + (_cvStackLength - 2) * BLAKE3_OUT_LEN;
+        blake3ParentOutput(left, left + BLAKE3_OUT_LEN, _key, _flags).chainingValue(left);
+        _cvStackLength--;
+    }
+}
+
+void BLAKE3::pushCv(const uint8_t cv[32], uint64_t chunkCounter) {
+    mergeCvStack(chunkCounter);
+    memcpy(_cvStack + _cvStackLength * BLAKE3_OUT_LEN, cv, BLAKE3_OUT_LEN);
+    _cvStackLength++;
+}
+
+Hash* BLAKE3::update(const uint8_t* data, size_t len) {
+    if (_finished) return this;
+    // Merging is lazy: the last chaining values are kept until more input arrives, since they may belong to the root.
+    if (chunkLength() > 0) {
+        size_t n = BLAKE3_CHUNK_LEN - chunkLength() < len ? BLAKE3_CHUNK_LEN - chunkLength() : len;
+        chunkUpdate(data, n);
+        data += n;
+        len -= n;
+        if (!len) return this;
+        BLAKE3Output o;
+        memcpy(o.cv, _chunkCv, sizeof(o.cv));
+        memcpy(o.block, _buffer, BLAKE3_BLOCK_LEN);
+        o.blockLen = BLAKE3_BLOCK_LEN;
+        o.counter = _chunkCounter;
+        o.flags = _flags | (_blocksCompressed ? 0 : BLAKE3_CHUNK_START) | BLAKE3_CHUNK_END;
+        uint8_t cv[BLAKE3_OUT_LEN];
+        o.chainingValue(cv);
+        pushCv(cv, _chunkCounter);
+        chunkReset(_chunkCounter + 1);
+    }
+    while (len > BLAKE3_CHUNK_LEN) {
+        // The largest subtree which starts at the current chunk and is a complete power of 2 count of chunks.
+        size_t subtreeLen = largestPowerOfTwoLeq(len);
+        uint64_t countSoFar = _chunkCounter * BLAKE3_CHUNK_LEN;
+        while (((uint64_t)subtreeLen - 1) & countSoFar) {
+            subtreeLen /= 2;
+        }
+        uint64_t subtreeChunks = subtreeLen / BLAKE3_CHUNK_LEN;
+        if (subtreeLen <= BLAKE3_CHUNK_LEN) {
+            uint8_t cv[BLAKE3_OUT_LEN];
+            blake3HashOne(data, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, _key, _chunkCounter, _flags, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, cv);
+            pushCv(cv, _chunkCounter);
+        } else {
+            uint8_t pair[2 * BLAKE3_OUT_LEN];
+            blake3CompressSubtreeToParentNode(data, subtreeLen, _key, _chunkCounter, _flags, _threads, pair);
+            pushCv(pair, _chunkCounter);
+            pushCv(pair + BLAKE3_OUT_LEN, _chunkCounter + subtreeChunks / 2);
+        }
+        _chunkCounter += subtreeChunks;
+        data += subtreeLen;
+        len -= subtreeLen;
+    }
+    if (len > 0) {
+        chunkUpdate(data, len);
+        mergeCvStack(_chunkCounter);
+    }
+    return this;
+}
+
+Hash* BLAKE3::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    BLAKE3Output o;
+    size_t remaining = _cvStackLength;
+    if (chunkLength() > 0 || !remaining) {
+        memcpy(o.cv, _chunkCv, sizeof(o.cv));
+        memset(o.block, 0, sizeof(o.block));
+        memcpy(o.block, _buffer, _bufferLength);
+        o.blockLen = (uint8_t)_bufferLength;
+        o.counter = _chunkCounter;
+        o.flags = _flags | (_blocksCompressed ? 0 : BLAKE3_CHUNK_START) | BLAKE3_CHUNK_END;
+    } else {
+        // There are at least 2 chaining values in the stack here.
+        o = blake3ParentOutput(_cvStack + (remaining - 2) * BLAKE3_OUT_LEN, _cvStack + (remaining - 1) * BLAKE3_OUT_LEN, _key, _flags);
+        remaining -= 2;
+    }
+    while (remaining > 0) {
+        uint8_t cv[BLAKE3_OUT_LEN];
+        o.chainingValue(cv);
+        o = blake3ParentOutput(_cvStack + (remaining - 1) * BLAKE3_OUT_LEN, cv, _key, _flags);
+        remaining--;
+    }
+    o.rootBytes(data, len);
+    return this;
+}
+
+std::vector<uint8_t> BLAKE3::exportState() {
+    if (_finished) return {};
+    StateWriter w(HASH_STATE_BLAKE3);
+    w.u8((uint8_t)_cvStackLength);
+    w.bytes(_cvStack, _cvStackLength * BLAKE3_OUT_LEN);
+    for (int i = 0; i < 8; i++) w.u32(_chunkCv[i]);
+    w.u64(_chunkCounter);
+    w.u8((uint8_t)_blocksCompressed);
+    w.u8((uint8_t)_bufferLength);
+    w.bytes(_buffer, _bufferLength);
+    return w.finish();
+}
+
+bool BLAKE3::importState(const uint8_t* data, size_t len) {
+    StateReader r(HASH_STATE_BLAKE3, data, len);
+    size_t cvStackLength = r.u8();
+    if (cvStackLength > sizeof(_cvStack) / BLAKE3_OUT_LEN) return false;
+    const uint8_t* cvStack = r.bytes(cvStackLength * BLAKE3_OUT_LEN);
+    uint32_t chunkCv[8];
+    for (int i = 0; i < 8; i++) chunkCv[i] = r.u32();
+    uint64_t chunkCounter = r.u64();
+    size_t blocksCompressed = r.u8();
+    size_t bufferLength = r.u8();
+    const uint8_t* buffer = r.bytes(bufferLength <= BLAKE3_BLOCK_LEN ? bufferLength : 0);
+    if (!r.end() || bufferLength > BLAKE3_BLOCK_LEN || blocksCompressed >= BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN) return false;
+    memcpy(_key, internal::BLAKE3_IV, sizeof(_key));
+    _flags = 0;
+    if (cvStackLength) memcpy(_cvStack, cvStack, cvStackLength * BLAKE3_OUT_LEN);
+    _cvStackLength = cvStackLength;
+    memcpy(_chunkCv, chunkCv, sizeof(_chunkCv));
+    _chunkCounter = chunkCounter;
+    _blocksCompressed = blocksCompressed;
+    if (bufferLength) memcpy(_buffer, buffer, bufferLength);
+    _bufferLength = bufferLength;
+    _finished = false;
+    return true;
+}
+
+#define CRC32_POLY 0xedb88320
+#define CRC32C_POLY 0x82f63b78
+
+/**
+ * Slicing-by-8 tables and the powers of x used to combine checksums, of a bit-reflected polynomial
+ */
+struct CRCTables {
+    uint32_t poly;
+    uint32_t slicing[8][256];
+    // x^(2^k) mod poly
+    uint32_t x2n[64];
+
+    explicit CRCTables(uint32_t p): poly(p) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++) {
+                crc = crc & 1 ? (crc >> 1) ^ poly : crc >> 1;
+            }
+            slicing[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                slicing[k][i] = (slicing[k - 1][i] >> 8) ^ slicing[0][slicing[k - 1][i] & 0xff];
+            }
+        }
+        uint32_t p2 = (uint32_t)1 << 30; // x^1
+        for (int k = 0; k < 64; k++) {
+            x2n[k] = p2;
+            p2 = multiply(p2, p2);
+        }
+    }
+
+    /**
+     * Multiply a and b modulo the polynomial
+     */
+    uint32_t multiply(uint32_t a, uint32_t b) const {
+        uint32_t m = (uint32_t)1 << 31, p = 0;
+        while (a) {
+            if (a & m) {
+                p ^= b;
+                a ^= m;
+            }
+            m >>= 1;
+            b = b & 1 ? (b >> 1) ^ poly : b >> 1;
+        }
+        return p;
+    }
+
+    /**
+     * @return x^(8 * len) mod poly, which advances a register over len zero bytes
+     */
+    uint32_t zeros(uint64_t len) const {
+        uint32_t p = (uint32_t)1 << 31; // x^0
+        for (int k = 3; len; len >>= 1, k++) {
+            if (len & 1) p = multiply(x2n[k & 63], p);
+        }
+        return p;
+    }
+
+    uint32_t update(uint32_t crc, const uint8_t* m, size_t len) const {
+        while (len >= 8) {
+            uint32_t lo = crc ^ cstr_read_uint32(m, 0);
+            uint32_t hi = cstr_read_uint32(m + 4, 0);
+            crc = slicing[7][lo & 0xff] ^ slicing[6][(lo >> 8) & 0xff] ^ slicing[5][(lo >> 16) & 0xff] ^ slicing[4][lo >> 24] ^
+                  slicing[3][hi & 0xff] ^ slicing[2][(hi >> 8) & 0xff] ^ slicing[1][(hi >> 16) & 0xff] ^ slicing[0][hi >> 24];
+            m += 8;
+            len -= 8;
+        }
+        while (len--) {
+            crc = (crc >> 8) ^ slicing[0][(crc ^ *m++) & 0xff];
+        }
+        return crc;
+    }
+
+    uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t len2) const {
+        return multiply(zeros(len2), crc1) ^ crc2;
+    }
+};
+
+static const CRCTables& crc32Tables() {
+    static const CRCTables tables(CRC32_POLY);
+    return tables;
+}
+
+static const CRCTables& crc32cTables() {
+    static const CRCTables tables(CRC32C_POLY);
+    return tables;
+}
+
+uint32_t hash_lib::internal::crc32Software(uint32_t crc, const uint8_t* m, size_t len) {
+    return crc32Tables().update(crc, m, len);
+}
+
+uint32_t hash_lib::internal::crc32cSoftware(uint32_t crc, const uint8_t* m, size_t len) {
+    return crc32cTables().update(crc, m, len);
+}
+
+static internal::CRC32CShiftTables makeCRC32CShiftTables() {
+    internal::CRC32CShiftTables re;
+    const CRCTables& tables = crc32cTables();
+    uint32_t longZeros = tables.zeros(internal::CRC32C_LONG);
+    uint32_t shortZeros = tables.zeros(internal::CRC32C_SHORT);
+    for (int k = 0; k < 4; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            re.longShift[k][i] = tables.multiply(longZeros, i << (8 * k));
+            re.shortShift[k][i] = tables.multiply(shortZeros, i << (8 * k));
+        }
+    }
+    return re;
+}
+
+const internal::CRC32CShiftTables& hash_lib::internal::crc32cShiftTables() {
+    static const CRC32CShiftTables tables = makeCRC32CShiftTables();
+    return tables;
+}
+
+static internal::CRCFunc crc32HardwareUpdate() {
+#if HASH_LIB_X86
+    if (cpu_util::has_pclmul()) return internal::crc32Pclmul;
+#endif
+#if HASH_LIB_ARM_CRC32
+    if (cpu_util::has_arm_crc32()) return internal::crc32Arm;
+#endif
+    return nullptr;
+}
+
+static internal::CRCFunc crc32cHardwareUpdate() {
+#if HASH_LIB_X86
+    if (cpu_util::has_sse42()) return internal::crc32cSse42;
+#endif
+#if HASH_LIB_ARM_CRC32
+    if (cpu_util::has_arm_crc32()) return internal::crc32cArm;
+#endif
+    return nullptr;
+}
+
+CRC32::CRC32() {
+    this->reset();
+}
+
+int CRC32::digestLength() {
+    return 4;
+}
+
+int CRC32::blockSize() {
+    return 1; // CRC is byte oriented
+}
+
+Hash* CRC32::reset() {
+    _crc = 0xffffffff;
+    _finished = false;
+    return this;
+}
+
+void CRC32::clean() {
+    reset();
+}
+
+Hash* CRC32::update(const uint8_t* data, size_t len) {
+    if (_finished) return this;
+    static const internal::CRCFunc hardwareUpdate = crc32HardwareUpdate();
+    if (hardwareUpdate && internal::useHardware()) {
+        _crc = hardwareUpdate(_crc, data, len);
+    } else {
+        _crc = crc32Tables().update(_crc, data, len);
+    }
+    return this;
+}
+
+uint32_t CRC32::value() {
+    return ~_crc;
+}
+
+Hash* CRC32::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    uint8_t re[4];
+    cstr_write_uint32(re, value(), 1);
+    memcpy(data, re, len < sizeof(re) ? len : sizeof(re));
+    return this;
+}
+
+std::vector<uint8_t> CRC32::exportState() {
+    if (_finished) return {};
+    StateWriter w(HASH_STATE_CRC32);
+    w.u32(_crc);
+    return w.finish();
+}
+
+bool CRC32::importState(const uint8_t* data, size_t len) {
+    StateReader r(HASH_STATE_CRC32, data, len);
+    uint32_t crc = r.u32();
+    if (!r.end()) return false;
+    _crc = crc;
+    _finished = false;
+    return true;
+}
+
+uint32_t CRC32::combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    return crc32Tables().combine(crc1, crc2, len2);
+}
+
+CRC32C::CRC32C() {
+    this->reset();
+}
+
+int CRC32C::digestLength() {
+    return 4;
+}
+
+int CRC32C::blockSize() {
+    return 1; // CRC is byte oriented
+}
+
+Hash* CRC32C::reset() {
+    _crc = 0xffffffff;
+    _finished = false;
+    return this;
+}
+
+void CRC32C::clean() {
+    reset();
+}
+
+Hash* CRC32C::update(const uint8_t* data, size_t len) {
+    if (_finished) return this;
+    static const internal::CRCFunc hardwareUpdate = crc32cHardwareUpdate();
+    if (hardwareUpdate && internal::useHardware()) {
+        _crc = hardwareUpdate(_crc, data, len);
+    } else {
+        _crc = crc32cTables().update(_crc, data, len);
+    }
+    return this;
+}
+
+uint32_t CRC32C::value() {
+    return ~_crc;
+}
+
+Hash* CRC32C::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    uint8_t re[4];
+    cstr_write_uint32(re, value(), 1);
+    memcpy(data, re, len < sizeof(re) ? len : sizeof(re));
+    return this;
+}
+
+std::vector<uint8_t> CRC32C::exportState() {
+    if (_finished) return {};
+    StateWriter w(HASH_STATE_CRC32C);
+    w.u32(_crc);
+    return w.finish();
+}
+
+bool CRC32C::importState(const uint8_t* data, size_t len) {
+    StateReader r(HASH_STATE_CRC32C, data, len);
+    uint32_t crc = r.u32();
+    if (!r.end()) return false;
+    _crc = crc;
+    _finished = false;
+    return true;
+}
+
+uint32_t CRC32C::combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    return crc32cTables().combine(crc1, crc2, len2);
+}
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPE_LEN 64
+#define XXH3_SECRET_CONSUME_RATE 8
+#define XXH3_STRIPES_PER_BLOCK ((XXH3_SECRET_SIZE - XXH3_STRIPE_LEN) / XXH3_SECRET_CONSUME_RATE)
+#define XXH3_BUFFER_SIZE 256
+#define XXH3_MIDSIZE_MAX 240
+#define XXH3_MIDSIZE_STARTOFFSET 3
+#define XXH3_MIDSIZE_LASTOFFSET 17
+#define XXH3_SECRET_LASTACC_START 7
+#define XXH3_SECRET_MERGEACCS_START 11
+
+// The default secret of XXH3
+static const uint8_t XXH3_SECRET[XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint32_t xxhSwap32(uint32_t x) {
+    return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000) | ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+}
+
+static inline uint64_t xxhSwap64(uint64_t x) {
+    return ((uint64_t)xxhSwap32((uint32_t)x) << 32) | xxhSwap32((uint32_t)(x >> 32));
+}
+
+// Inlined little endian loads, the short input paths are dominated by them.
+static inline uint32_t xxhRead32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = xxhSwap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t xxhRead64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = xxhSwap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t xxhRotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint32_t xxhRotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline XXH128Value xxhMult64to128(uint64_t a, uint64_t b) {
+    XXH128Value re;
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t)a * b;
+    re.low = (uint64_t)product;
+    re.high = (uint64_t)(product >> 64);
+#else
+    uint64_t loLo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    uint64_t hiLo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t loHi = (a & 0xFFFFFFFF) * (b >> 32);
+    uint64_t hiHi = (a >> 32) * (b >> 32);
+    uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+    re.high = (hiLo >> 32) + (cross >> 32) + hiHi;
+    re.low = (cross << 32) | (loLo & 0xFFFFFFFF);
+#endif
+    return re;
+}
+
+static inline uint64_t xxhMul128Fold64(uint64_t a, uint64_t b) {
+    XXH128Value product = xxhMult64to128(a, b);
+    return product.low ^ product.high;
+}
+
+static inline uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3Avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3Rrmxmx(uint64_t h, uint64_t len) {
+    h ^= xxhRotl64(h, 49) ^ xxhRotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    h ^= h >> 28;
+    return h;
+}
+
+static inline uint64_t xxh3Mix16B(const uint8_t* input, const uint8_t* secret, uint64_t seed) {
+    uint64_t lo = xxhRead64(input);
+    uint64_t hi = xxhRead64(input + 8);
+    return xxhMul128Fold64(lo ^ (xxhRead64(secret) + seed), hi ^ (xxhRead64(secret + 8) - seed));
+}
+
+static inline void xxh3Mix32B(XXH128Value& acc, const uint8_t* input1, const uint8_t* input2, const uint8_t* secret, uint64_t seed) {
+    acc.low += xxh3Mix16B(input1, secret, seed);
+    acc.low ^= xxhRead64(input2) + xxhRead64(input2 + 8);
+    acc.high += xxh3Mix16B(input2, secret + 16, seed);
+    acc.high ^= xxhRead64(input1) + xxhRead64(input1 + 8);
+}
+
+/**
+ * XXH3 64-bit hash of at most XXH3_MIDSIZE_MAX bytes
+ */
+static uint64_t xxh3Hash64Short(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed) {
+    if (len > 128) {
+        uint64_t acc = len * XXH_PRIME64_1;
+        size_t rounds = len / 16;
+        for (size_t i = 0; i < 8; i++) {
+            acc += xxh3Mix16B(input + 16 * i, secret + 16 * i, seed);
+        }
+        uint64_t accEnd = xxh3Mix16B(input + len - 16, secret + 136 - XXH3_MIDSIZE_LASTOFFSET, seed);
+        acc = xxh3Avalanche(acc);
+        for (size_t i = 8; i < rounds; i++) {
+            accEnd += xxh3Mix16B(input + 16 * i, secret + 16 * (i - 8) + XXH3_MIDSIZE_STARTOFFSET, seed);
+        }
+        return xxh3Avalanche(acc + accEnd);
+    }
+    if (len > 16) {
+        uint64_t acc = len * XXH_PRIME64_1;
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3Mix16B(input + 48, secret + 96, seed);
+                    acc += xxh3Mix16B(input + len - 64, secret + 112, seed);
+                }
+                acc += xxh3Mix16B(input + 32, secret + 64, seed);
+                acc += xxh3Mix16B(input + len - 48, secret + 80, seed);
+            }
+            acc += xxh3Mix16B(input + 16, secret + 32, seed);
+            acc += xxh3Mix16B(input + len - 32, secret + 48, seed);
+        }
+        acc += xxh3Mix16B(input, secret, seed);
+        acc += xxh3Mix16B(input + len - 16, secret + 16, seed);
+        return xxh3Avalanche(acc);
+    }
+    if (len > 8) {
+        uint64_t bitflip1 = (xxhRead64(secret + 24) ^ xxhRead64(secret + 32)) + seed;
+        uint64_t bitflip2 = (xxhRead64(secret + 40) ^ xxhRead64(secret + 48)) - seed;
+        uint64_t inputLo = xxhRead64(input) ^ bitflip1;
+        uint64_t inputHi = xxhRead64(input + len - 8) ^ bitflip2;
+        uint64_t acc = len + xxhSwap64(inputLo) + inputHi + xxhMul128Fold64(inputLo, inputHi);
+        return xxh3Avalanche(acc);
+    }
+    if (len >= 4) {
+        seed ^= (uint64_t)xxhSwap32((uint32_t)seed) << 32;
+        uint32_t input1 = xxhRead32(input);
+        uint32_t input2 = xxhRead32(input + len - 4);
+        uint64_t bitflip = (xxhRead64(secret + 8) ^ xxhRead64(secret + 16)) - seed;
+        uint64_t input64 = input2 + ((uint64_t)input1 << 32);
+        return xxh3Rrmxmx(input64 ^ bitflip, len);
+    }
+    if (len > 0) {
+        uint32_t combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) | ((uint32_t)input[len - 1]) | ((uint32_t)len << 8);
+        uint64_t bitflip = (xxhRead32(secret) ^ xxhRead32(secret + 4)) + seed;
+        return xxh64Avalanche((uint64_t)combined ^ bitflip);
+    }
+    return xxh64Avalanche(seed ^ (xxhRead64(secret + 56) ^ xxhRead64(secret + 64)));
+}
+
+/**
+ * XXH3 128-bit hash of at most XXH3_MIDSIZE_MAX bytes
+ */
+static XXH128Value xxh3Hash128Short(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed) {
+    XXH128Value h;
+    if (len > 16) {
+        XXH128Value acc;
+        acc.low = len * XXH_PRIME64_1;
+        acc.high = 0;
+        if (len > 128) {
+            size_t rounds = len / 32;
+            for (size_t i = 0; i < 4; i++) {
+                xxh3Mix32B(acc, input + 32 * i, input + 32 * i + 16, secret + 32 * i, seed);
+            }
+            acc.low = xxh3Avalanche(acc.low);
+            acc.high = xxh3Avalanche(acc.high);
+            for (size_t i = 4; i < rounds; i++) {
+                xxh3Mix32B(acc, input + 32 * i, input + 32 * i + 16, secret + XXH3_MIDSIZE_STARTOFFSET + 32 * (i - 4), seed);
+            }
+            xxh3Mix32B(acc, input + len - 16, input + len - 32, secret + 136 - XXH3_MIDSIZE_LASTOFFSET - 16, 0 - seed);
+        } else {
+            if (len > 32) {
+                if (len > 64) {
+                    if (len > 96) {
+                        xxh3Mix32B(acc, input + 48, input + len - 64, secret + 96, seed);
+                    }
+                    xxh3Mix32B(acc, input + 32, input + len - 48, secret + 64, seed);
+                }
+                xxh3Mix32B(acc, input + 16, input + len - 32, secret + 32, seed);
+            }
+            xxh3Mix32B(acc, input, input + len - 16, secret, seed);
+        }
+        h.low = acc.low + acc.high;
+        h.high = acc.low * XXH_PRIME64_1 + acc.high * XXH_PRIME64_4 + (len - seed) * XXH_PRIME64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = 0 - xxh3Avalanche(h.high);
+        return h;
+    }
+    if (len > 8) {
+        uint64_t bitflipLo = (xxhRead64(secret + 32) ^ xxhRead64(secret + 40)) - seed;
+        uint64_t bitflipHi = (xxhRead64(secret + 48) ^ xxhRead64(secret + 56)) + seed;
+        uint64_t inputLo = xxhRead64(input);
+        uint64_t inputHi = xxhRead64(input + len - 8);
+        XXH128Value m = xxhMult64to128(inputLo ^ inputHi ^ bitflipLo, XXH_PRIME64_1);
+        m.low += (uint64_t)(len - 1) << 54;
+        inputHi ^= bitflipHi;
+        m.high += inputHi + (uint64_t)(uint32_t)inputHi * (XXH_PRIME32_2 - 1);
+        m.low ^= xxhSwap64(m.high);
+        h = xxhMult64to128(m.low, XXH_PRIME64_2);
+        h.high += m.high * XXH_PRIME64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = xxh3Avalanche(h.high);
+        return h;
+    }
+    if (len >= 4) {
+        seed ^= (uint64_t)xxhSwap32((uint32_t)seed) << 32;
+        uint32_t inputLo = xxhRead32(input);
+        uint32_t inputHi = xxhRead32(input + len - 4);
+        uint64_t input64 = inputLo + ((uint64_t)inputHi << 32);
+        uint64_t bitflip = (xxhRead64(secret + 16) ^ xxhRead64(secret + 24)) + seed;
+        // Shift len to the left so the multiplier is always even
+        h = xxhMult64to128(input64 ^ bitflip, XXH_PRIME64_1 + (len << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= XXH_PRIME_MX2;
+        h.low ^= h.low >> 28;
+        h.high = xxh3Avalanche(h.high);
+        return h;
+    }
+    if (len > 0) {
+        uint32_t combinedLo = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) | ((uint32_t)input[len - 1]) | ((uint32_t)len << 8);
+        uint32_t combinedHi = xxhRotl32(xxhSwap32(combinedLo), 13);
+        uint64_t bitflipLo = (xxhRead32(secret) ^ xxhRead32(secret + 4)) + seed;
+        uint64_t bitflipHi = (xxhRead32(secret + 8) ^ xxhRead32(secret + 12)) - seed;
+        h.low = xxh64Avalanche((uint64_t)combinedLo ^ bitflipLo);
+        h.high = xxh64Avalanche((uint64_t)combinedHi ^ bitflipHi);
+        return h;
+    }
+    h.low = xxh64Avalanche(seed ^ (xxhRead64(secret + 64) ^ xxhRead64(secret + 72)));
+    h.high = xxh64Avalanche(seed ^ (xxhRead64(secret + 80) ^ xxhRead64(secret + 88)));
+    return h;
+}
+
+static void xxh3AccumulateScalar(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes) {
+    for (size_t s = 0; s < stripes; s++) {
+        const uint8_t* in = input + s * XXH3_STRIPE_LEN;
+        const uint8_t* key = secret + s * XXH3_SECRET_CONSUME_RATE;
+        for (int i = 0; i < 8; i++) {
+            uint64_t data = xxhRead64(in + 8 * i);
+            uint64_t dataKey = data ^ xxhRead64(key + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+        }
+    }
+}
+
+static void xxh3ScrambleScalar(uint64_t acc[8], const uint8_t* secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= xxhRead64(secret + 8 * i);
+        acc[i] = a * XXH_PRIME32_1;
+    }
+}
+
+struct XXH3Engine {
+    internal::XXH3AccumulateFunc accumulate;
+    internal::XXH3ScrambleFunc scramble;
+};
+
+static XXH3Engine xxh3HardwareEngine() {
+#if HASH_LIB_X86
+    if (cpu_util::has_avx2()) return { internal::xxh3AccumulateAvx2, internal::xxh3ScrambleAvx2 };
+#if defined(__x86_64__) || defined(_M_X64)
+    // SSE2 is always available on x86-64
+    return { internal::xxh3AccumulateSse2, internal::xxh3ScrambleSse2 };
+#endif
+#endif
+#if HASH_LIB_ARM_NEON
+    return { internal::xxh3AccumulateNeon, internal::xxh3ScrambleNeon };
+#endif
+    return { xxh3AccumulateScalar, xxh3ScrambleScalar };
+}
+
+static XXH3Engine xxh3Engine() {
+    static const XXH3Engine hardware = xxh3HardwareEngine();
+    if (internal::useHardware()) return hardware;
+    return { xxh3AccumulateScalar, xxh3ScrambleScalar };
+}
+
+/**
+ * Accumulate stripes into acc, scrambling acc at the end of every block
+ * @param stripesSoFar Count of stripes already accumulated in the current block
+ */
+static void xxh3ConsumeStripes(const XXH3Engine& engine, uint64_t acc[8], size_t& stripesSoFar, const uint8_t* secret, const uint8_t* input, size_t stripes) {
+    while (stripes) {
+        size_t n = XXH3_STRIPES_PER_BLOCK - stripesSoFar;
+        if (n > stripes) n = stripes;
+        engine.accumulate(acc, input, secret + stripesSoFar * XXH3_SECRET_CONSUME_RATE, n);
+        stripesSoFar += n;
+        input += n * XXH3_STRIPE_LEN;
+        stripes -= n;
+        if (stripesSoFar == XXH3_STRIPES_PER_BLOCK) {
+            engine.scramble(acc, secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN);
+            stripesSoFar = 0;
+        }
+    }
+}
+
+static void xxh3InitAcc(uint64_t acc[8]) {
+    acc[0] = XXH_PRIME32_3;
+    acc[1] = XXH_PRIME64_1;
+    acc[2] = XXH_PRIME64_2;
+    acc[3] = XXH_PRIME64_3;
+    acc[4] = XXH_PRIME64_4;
+    acc[5] = XXH_PRIME32_2;
+    acc[6] = XXH_PRIME64_5;
+    acc[7] = XXH_PRIME32_1;
+}
+
+static void xxh3InitSecret(uint8_t secret[XXH3_SECRET_SIZE], uint64_t seed) {
+    for (int i = 0; i < XXH3_SECRET_SIZE / 16; i++) {
+        uint64_t lo = xxhRead64(XXH3_SECRET + 16 * i) + seed;
+        uint64_t hi = xxhRead64(XXH3_SECRET + 16 * i + 8) - seed;
+        cstr_write_uint64(secret + 16 * i, lo, 0);
+        cstr_write_uint64(secret + 16 * i + 8, hi, 0);
+    }
+}
+
+/**
+ * Accumulate an input of more than XXH3_MIDSIZE_MAX bytes
+ */
+static void xxh3HashLong(uint64_t acc[8], const uint8_t* input, size_t len, const uint8_t* secret) {
+    const XXH3Engine engine = xxh3Engine();
+    xxh3InitAcc(acc);
+    size_t stripesSoFar = 0;
+    xxh3ConsumeStripes(engine, acc, stripesSoFar, secret, input, (len - 1) / XXH3_STRIPE_LEN);
+    engine.accumulate(acc, input + len - XXH3_STRIPE_LEN, secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - XXH3_SECRET_LASTACC_START, 1);
+}
+
+static uint64_t xxh3MergeAccs(const uint64_t acc[8], const uint8_t* secret, uint64_t start) {
+    uint64_t re = start;
+    for (int i = 0; i < 4; i++) {
+        re += xxhMul128Fold64(acc[2 * i] ^ xxhRead64(secret + 16 * i), acc[2 * i + 1] ^ xxhRead64(secret + 16 * i + 8));
+    }
+    return xxh3Avalanche(re);
+}
+
+static uint64_t xxh3Finalize64(const uint64_t acc[8], const uint8_t* secret, uint64_t len) {
+    return xxh3MergeAccs(acc, secret + XXH3_SECRET_MERGEACCS_START, len * XXH_PRIME64_1);
+}
+
+static XXH128Value xxh3Finalize128(const uint64_t acc[8], const uint8_t* secret, uint64_t len) {
+    XXH128Value re;
+    re.low = xxh3MergeAccs(acc, secret + XXH3_SECRET_MERGEACCS_START, len * XXH_PRIME64_1);
+    re.high = xxh3MergeAccs(acc, secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - XXH3_SECRET_MERGEACCS_START, ~(len * XXH_PRIME64_2));
+    return re;
+}
+
+uint64_t hash_lib::xxh3Hash64(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* input = (const uint8_t*)data;
+    if (len <= XXH3_MIDSIZE_MAX) return xxh3Hash64Short(input, len, XXH3_SECRET, seed);
+    uint8_t custom[XXH3_SECRET_SIZE];
+    const uint8_t* secret = XXH3_SECRET;
+    if (seed) {
+        xxh3InitSecret(custom, seed);
+        secret = custom;
+    }
+    uint64_t acc[8];
+    xxh3HashLong(acc, input, len, secret);
+    return xxh3Finalize64(acc, secret, len);
+}
+
+XXH128Value hash_lib::xxh3Hash128(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* input = (const uint8_t*)data;
+    if (len <= XXH3_MIDSIZE_MAX) return xxh3Hash128Short(input, len, XXH3_SECRET, seed);
+    uint8_t custom[XXH3_SECRET_SIZE];
+    const uint8_t* secret = XXH3_SECRET;
+    if (seed) {
+        xxh3InitSecret(custom, seed);
+        secret = custom;
+    }
+    uint64_t acc[8];
+    xxh3HashLong(acc, input, len, secret);
+    return xxh3Finalize128(acc, secret, len);
+}
+
+XXH3_64::XXH3_64(): XXH3_64(0) {}
+
+XXH3_64::XXH3_64(uint64_t seed): _seed(seed) {
+    xxh3InitSecret(_secret, seed);
+    this->reset();
+}
+
+int XXH3_64::digestLength() {
+    return 8;
+}
+
+int XXH3_64::blockSize() {
+    return XXH3_STRIPE_LEN;
+}
+
+Hash* XXH3_64::reset() {
+    xxh3InitAcc(_acc);
+    _bufferLength = 0;
+    _stripesSoFar = 0;
+    _totalLength = 0;
+    _finished = false;
+    return this;
+}
+
+void XXH3_64::clean() {
+    cleanBuffer(_buffer);
+    reset();
+}
+
+Hash* XXH3_64::update(const uint8_t* data, size_t len) {
+    if (_finished || !len) return this;
+    _totalLength += len;
+    // Keep at least one byte buffered, the last stripe is handled differently when digesting.
+    if (_bufferLength + len <= XXH3_BUFFER_SIZE) {
+        memcpy(_buffer + _bufferLength, data, len);
+        _bufferLength += len;
+        return this;
+    }
+    const XXH3Engine engine = xxh3Engine();
+    if (_bufferLength) {
+        size_t fill = XXH3_BUFFER_SIZE - _bufferLength;
+        memcpy(_buffer + _bufferLength, data, fill);
+        data += fill;
+        len -= fill;
+        xxh3ConsumeStripes(engine, _acc, _stripesSoFar, _secret, _buffer, XXH3_BUFFER_SIZE / XXH3_STRIPE_LEN);
+        _bufferLength = 0;
+    }
+    if (len > XXH3_BUFFER_SIZE) {
+        size_t stripes = (len - 1) / XXH3_STRIPE_LEN;
+        xxh3ConsumeStripes(engine, _acc, _stripesSoFar, _secret, data, stripes);
+        data += stripes * XXH3_STRIPE_LEN;
+        len -= stripes * XXH3_STRIPE_LEN;
+        memcpy(_buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN, data - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    }
+    memcpy(_buffer, data, len);
+    _bufferLength = len;
+    return this;
+}
+
+void XXH3_64::digestLong(uint64_t acc[8]) {
+    const XXH3Engine engine = xxh3Engine();
+    memcpy(acc, _acc, sizeof(_acc));
+    size_t stripesSoFar = _stripesSoFar;
+    uint8_t lastStripe[XXH3_STRIPE_LEN];
+    const uint8_t* last;
+    if (_bufferLength >= XXH3_STRIPE_LEN) {
+        xxh3ConsumeStripes(engine, acc, stripesSoFar, _secret, _buffer, (_bufferLength - 1) / XXH3_STRIPE_LEN);
+        last = _buffer + _bufferLength - XXH3_STRIPE_LEN;
+    } else {
+        // The last stripe starts in the previously consumed data
+        size_t catchup = XXH3_STRIPE_LEN - _bufferLength;
+        memcpy(lastStripe, _buffer + XXH3_BUFFER_SIZE - catchup, catchup);
+        memcpy(lastStripe + catchup, _buffer, _bufferLength);
+        last = lastStripe;
+    }
+    engine.accumulate(acc, last, _secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - XXH3_SECRET_LASTACC_START, 1);
+}
+
+uint64_t XXH3_64::value() {
+    if (_totalLength <= XXH3_MIDSIZE_MAX) return xxh3Hash64Short(_buffer, (size_t)_totalLength, XXH3_SECRET, _seed);
+    uint64_t acc[8];
+    digestLong(acc);
+    return xxh3Finalize64(acc, _secret, _totalLength);
+}
+
+Hash* XXH3_64::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    uint8_t re[8];
+    cstr_write_uint64(re, value(), 1);
+    memcpy(data, re, len < sizeof(re) ? len : sizeof(re));
+    return this;
+}
+
+std::vector<uint8_t> XXH3_64::exportState() {
+    if (_finished) return {};
+    StateWriter w(digestLength() == 16 ? HASH_STATE_XXH3_128 : HASH_STATE_XXH3_64);
+    w.u64(_seed);
+    for (int i = 0; i < 8; i++) w.u64(_acc[i]);
+    w.u64(_totalLength);
+    w.u8((uint8_t)_stripesSoFar);
+    w.u32((uint32_t)_bufferLength);
+    w.bytes(_buffer, _bufferLength);
+    // The last consumed stripe, kept at the end of the buffer
+    if (_totalLength > _bufferLength && _bufferLength < XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN) {
+        w.bytes(_buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    }
+    return w.finish();
+}
+
+bool XXH3_64::importState(const uint8_t* data, size_t len) {
+    StateReader r(digestLength() == 16 ? HASH_STATE_XXH3_128 : HASH_STATE_XXH3_64, data, len);
+    uint64_t seed = r.u64();
+    uint64_t acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = r.u64();
+    uint64_t totalLength = r.u64();
+    size_t stripesSoFar = r.u8();
+    size_t bufferLength = r.u32();
+    if (bufferLength > XXH3_BUFFER_SIZE || bufferLength > totalLength || (totalLength && !bufferLength) || stripesSoFar >= XXH3_STRIPES_PER_BLOCK) return false;
+    const uint8_t* buffer = r.bytes(bufferLength);
+    const uint8_t* lastStripe = nullptr;
+    if (totalLength > bufferLength && bufferLength < XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN) {
+        lastStripe = r.bytes(XXH3_STRIPE_LEN);
+    }
+    if (!r.end()) return false;
+    if (seed != _seed) {
+        _seed = seed;
+        xxh3InitSecret(_secret, seed);
+    }
+    memcpy(_acc, acc, sizeof(_acc));
+    _totalLength = totalLength;
+    _stripesSoFar = stripesSoFar;
+    if (lastStripe) memcpy(_buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN, lastStripe, XXH3_STRIPE_LEN);
+    if (bufferLength) memcpy(_buffer, buffer, bufferLength);
+    _bufferLength = bufferLength;
+    _finished = false;
+    return true;
+}
+
+XXH3_128::XXH3_128(): XXH3_64(0) {}
+
+XXH3_128::XXH3_128(uint64_t seed): XXH3_64(seed) {}
+
+int XXH3_128::digestLength() {
+    return 16;
+}
+
+XXH128Value XXH3_128::value() {
+    if (_totalLength <= XXH3_MIDSIZE_MAX) return xxh3Hash128Short(_buffer, (size_t)_totalLength, XXH3_SECRET, _seed);
+    uint64_t acc[8];
+    digestLong(acc);
+    return xxh3Finalize128(acc, _secret, _totalLength);
+}
+
+Hash* XXH3_128::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    uint8_t re[16];
+    XXH128Value v = value();
+    cstr_write_uint64(re, v.high, 1);
+    cstr_write_uint64(re + 8, v.low, 1);
+    memcpy(data, re, len < sizeof(re) ? len : sizeof(re));
+    return this;
+}
+
+#define SHA3_DOMAIN 0x06
+#define SHAKE_DOMAIN 0x1f
+
+const uint64_t hash_lib::internal::KECCAK_RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+#define KECCAK_ROTL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+#define KECCAK_CHI(E, i, B0, B1, B2, B3, B4) \
+        E[i] = B0 ^ (~B1 & B2); \
+        E[i + 1] = B1 ^ (~B2 & B3); \
+        E[i + 2] = B2 ^ (~B3 & B4); \
+        E[i + 3] = B3 ^ (~B4 & B0); \
+        E[i + 4] = B4 ^ (~B0 & B1);
+// theta, rho, pi, chi and iota of one round from lanes A to lanes E, lane (x, y) is A[x + 5 * y]
+#define KECCAK_ROUND(A, E, rc) { \
+        uint64_t C0 = A[0] ^ A[5] ^ A[10] ^ A[15] ^ A[20]; \
+        uint64_t C1 = A[1] ^ A[6] ^ A[11] ^ A[16] ^ A[21]; \
+        uint64_t C2 = A[2] ^ A[7] ^ A[12] ^ A[17] ^ A[22]; \
+        uint64_t C3 = A[3] ^ A[8] ^ A[13] ^ A[18] ^ A[23]; \
+        uint64_t C4 = A[4] ^ A[9] ^ A[14] ^ A[19] ^ A[24]; \
+        uint64_t D0 = C4 ^ KECCAK_ROTL(C1, 1); \
+        uint64_t D1 = C0 ^ KECCAK_ROTL(C2, 1); \
+        uint64_t D2 = C1 ^ KECCAK_ROTL(C3, 1); \
+        uint64_t D3 = C2 ^ KECCAK_ROTL(C4, 1); \
+        uint64_t D4 = C3 ^ KECCAK_ROTL(C0, 1); \
+        uint64_t B0, B1, B2, B3, B4; \
+        B0 = A[0] ^ D0; B1 = KECCAK_ROTL(A[6] ^ D1, 44); B2 = KECCAK_ROTL(A[12] ^ D2, 43); \
+        B3 = KECCAK_ROTL(A[18] ^ D3, 21); B4 = KECCAK_ROTL(A[24] ^ D4, 14); \
+        KECCAK_CHI(E, 0, B0, B1, B2, B3, B4); \
+        E[0] ^= rc; \
+        B0 = KECCAK_ROTL(A[3] ^ D3, 28); B1 = KECCAK_ROTL(A[9] ^ D4, 20); B2 = KECCAK_ROTL(A[10] ^ D0, 3); \
+        B3 = KECCAK_ROTL(A[16] ^ D1, 45); B4 = KECCAK_ROTL(A[22] ^ D2, 61); \
+        KECCAK_CHI(E, 5, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_ROTL(A[1] ^ D1, 1); B1 = KECCAK_ROTL(A[7] ^ D2, 6); B2 = KECCAK_ROTL(A[13] ^ D3, 25); \
+        B3 = KECCAK_ROTL(A[19] ^ D4, 8); B4 = KECCAK_ROTL(A[20] ^ D0, 18); \
+        KECCAK_CHI(E, 10, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_ROTL(A[4] ^ D4, 27); B1 = KECCAK_ROTL(A[5] ^ D0, 36); B2 = KECCAK_ROTL(A[11] ^ D1, 10); \
+        B3 = KECCAK_ROTL(A[17] ^ D2, 15); B4 = KECCAK_ROTL(A[23] ^ D3, 56); \
+        KECCAK_CHI(E, 15, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_ROTL(A[2] ^ D2, 62); B1 = KECCAK_ROTL(A[8] ^ D3, 55); B2 = KECCAK_ROTL(A[14] ^ D4, 39); \
+        B3 = KECCAK_ROTL(A[15] ^ D0, 41); B4 = KECCAK_ROTL(A[21] ^ D1, 2); \
+        KECCAK_CHI(E, 20, B0, B1, B2, B3, B4); \
+    }
+
+/**
+ * Keccak-f[1600] permutation.
+ * Rounds alternate between two sets of lanes, so lanes stay in registers instead of being copied back.
+ */
+static void keccakF1600(uint64_t state[25]) {
+    uint64_t a[25], e[25];
+    memcpy(a, state, sizeof(a));
+    for (int round = 0; round < 24; round += 2) {
+        KECCAK_ROUND(a, e, internal::KECCAK_RC[round]);
+        KECCAK_ROUND(e, a, internal::KECCAK_RC[round + 1]);
+    }
+    memcpy(state, a, sizeof(a));
+}
+
+static void keccakAbsorb(uint64_t state[25], const uint8_t* m, size_t blocks, size_t rate) {
+    while (blocks--) {
+        for (size_t i = 0; i < rate / 8; i++) {
+            state[i] ^= xxhRead64(m + i * 8);
+        }
+        keccakF1600(state);
+        m += rate;
+    }
+}
+
+/**
+ * Pad and absorb the last partial block
+ * @param left Length of the partial block, less than rate
+ */
+static void keccakAbsorbLast(uint64_t state[25], const uint8_t* m, size_t left, size_t rate, bool xof) {
+    uint8_t block[168];
+    // m may be null for an empty message
+    if (left) memcpy(block, m, left);
+    memset(block + left, 0, rate - left);
+    block[left] = xof ? SHAKE_DOMAIN : SHA3_DOMAIN;
+    block[rate - 1] |= 0x80;
+    keccakAbsorb(state, block, 1, rate);
+}
+
+/**
+ * Squeeze output from a sponge whose input is fully absorbed
+ */
+static void keccakSqueeze(uint64_t state[25], size_t rate, uint8_t* out, size_t len) {
+    uint8_t block[168];
+    while (true) {
+        size_t n = len < rate ? len : rate;
+        for (size_t i = 0; i < (n + 7) / 8; i++) {
+            cstr_write_uint64(block + i * 8, state[i], 0);
+        }
+        memcpy(out, block, n);
+        out += n;
+        len -= n;
+        if (!len) break;
+        keccakF1600(state);
+    }
+}
+
+SHA3::SHA3(int rate, int digestLength, bool xof): _rate(rate), _digestLength(digestLength), _xof(xof) {
+    this->reset();
+}
+
+int SHA3::digestLength() {
+    return _digestLength;
+}
+
+int SHA3::blockSize() {
+    return _rate;
+}
+
+Hash* SHA3::reset() {
+    memset(_state, 0, sizeof(_state));
+    _bufferLength = 0;
+    _finished = false;
+    return this;
+}
+
+void SHA3::clean() {
+    cleanBuffer(_buffer);
+    reset();
+}
+
+Hash* SHA3::update(const uint8_t* data, size_t len) {
+    if (_finished) return this;
+    size_t rate = _rate;
+    blockUpdate(_buffer, _bufferLength, rate, data, len, [this, rate](const uint8_t* m, size_t l) {
+        keccakAbsorb(_state, m, l / rate, rate);
+    });
+    return this;
+}
+
+Hash* SHA3::finish(uint8_t* data, size_t len) {
+    _finished = true;
+    // Pad a copy of the state, so finish can be called again
+    uint64_t state[25];
+    memcpy(state, _state, sizeof(state));
+    keccakAbsorbLast(state, _buffer, _bufferLength, _rate, _xof);
+    if (!_xof && len > (size_t)_digestLength) len = _digestLength;
+    keccakSqueeze(state, _rate, data, len);
+    return this;
+}
+
+std::vector<uint8_t> SHA3::exportState() {
+    if (_finished) return {};
+    StateWriter w(HASH_STATE_SHA3);
+    w.u8((uint8_t)_rate);
+    w.u32((uint32_t)_digestLength);
+    w.u8(_xof);
+    for (int i = 0; i < 25; i++) w.u64(_state[i]);
+    w.u8((uint8_t)_bufferLength);
+    w.bytes(_buffer, _bufferLength);
+    return w.finish();
+}
+
+bool SHA3::importState(const uint8_t* data, size_t len) {
+    StateReader r(HASH_STATE_SHA3, data, len);
+    // Only states of the same member of the family are accepted
+    if (r.u8() != _rate || r.u32() != (uint32_t)_digestLength || r.u8() != _xof) return false;
+    uint64_t state[25];
+    for (int i = 0; i < 25; i++) state[i] = r.u64();
+    size_t bufferLength = r.u8();
+    if (bufferLength >= (size_t)_rate) return false;
+    const uint8_t* buffer = r.bytes(bufferLength);
+    if (!r.end()) return false;
+    memcpy(_state, state, sizeof(_state));
+    if (bufferLength) memcpy(_buffer, buffer, bufferLength);
+    _bufferLength = bufferLength;
+    _finished = false;
+    return true;
+}
+
+SHA3_224::SHA3_224(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, false) {}
+
+SHA3_256::SHA3_256(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, false) {}
+
+SHA3_384::SHA3_384(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, false) {}
+
+SHA3_512::SHA3_512(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, false) {}
+
+SHAKE128::SHAKE128(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, true) {}
+
+SHAKE128::SHAKE128(int digestLength): SHA3(BLOCK_SIZE, digestLength, true) {}
+
+SHAKE256::SHAKE256(): SHA3(BLOCK_SIZE, DIGEST_LENGTH, true) {}
+
+SHAKE256::SHAKE256(int digestLength): SHA3(BLOCK_SIZE, digestLength, true) {}
+
+static internal::KeccakX4AbsorbFunc keccakHardwareAbsorb4() {
+#if HASH_LIB_X86
+    if (cpu_util::has_avx2()) return internal::keccakX4AbsorbAvx2;
+#endif
+    return nullptr;
+}
+
+void hash_lib::internal::sha3Batch(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, size_t rate, size_t digestLength, bool xof) {
+    static const KeccakX4AbsorbFunc absorb4 = keccakHardwareAbsorb4();
+    if (!absorb4 || count < 2 || !useHardware()) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t state[25] = { 0 };
+            size_t left = lens[i] % rate;
+            keccakAbsorb(state, data[i], lens[i] / rate, rate);
+            keccakAbsorbLast(state, data[i] + lens[i] - left, left, rate, xof);
+            keccakSqueeze(state, rate, out + i * digestLength, digestLength);
+        }
+        return;
+    }
+    const size_t lanes = 4;
+    uint64_t state[25 * 4] = {};
+    batchLanes(data, lens, count, lanes, rate,
+        [&](uint8_t* buffer, const uint8_t* m, size_t len) {
+            size_t left = len % rate;
+            if (left) memcpy(buffer, m + len - left, left);
+            memset(buffer + left, 0, rate - left);
+            buffer[left] = xof ? SHAKE_DOMAIN : SHA3_DOMAIN;
+            buffer[rate - 1] |= 0x80;
+            return (size_t)1;
+        },
+        [&](size_t j) {
+            for (int i = 0; i < 25; i++) {
+                state[i * lanes + j] = 0;
+            }
+        },
+        [&](const uint8_t** m, size_t blocks) {
+            absorb4(state, m, blocks, rate);
+        },
+        [&](size_t j, size_t index) {
+            uint64_t s[25];
+            for (int i = 0; i < 25; i++) {
+                s[i] = state[i * lanes + j];
+            }
+            keccakSqueeze(s, rate, out + index * digestLength, digestLength);
+        });
+}
+
+namespace {
+    /**
+     * Threads kept alive across parallelFor calls, so hashing many medium inputs does not start threads each time.
+     * Callers run items of their own job too, so nested or concurrent calls always make progress.
+     */
+    class WorkerPool {
+    public:
+        static WorkerPool& instance() {
+            static WorkerPool pool;
+            return pool;
+        }
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _jobCv.notify_all();
+            for (auto& t : _workers) t.join();
+        }
+        void run(size_t count, unsigned int threads, const std::function<void(size_t)>& f) {
+            auto job = std::make_shared<Job>();
+            job->f = &f;
+            job->count = count;
+            job->helpers = threads - 1;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                while (_workers.size() < job->helpers && _workers.size() < WORKER_POOL_MAX) {
+                    _workers.emplace_back([this]() { work(); });
+                }
+                _jobs.push_back(job);
+            }
+            _jobCv.notify_all();
+            runItems(*job);
+            std::unique_lock<std::mutex> lock(_mutex);
+            _doneCv.wait(lock, [&]() { return job->done.load() == job->count; });
+            auto it = std::find(_jobs.begin(), _jobs.end(), job);
+            if (it != _jobs.end()) _jobs.erase(it);
+        }
+    private:
+        static const size_t WORKER_POOL_MAX = 256;
+        struct Job {
+            const std::function<void(size_t)>* f;
+            size_t count;
+            std::atomic<size_t> next { 0 };
+            std::atomic<size_t> done { 0 };
+            // Count of workers which may still join, guarded by _mutex
+            unsigned int helpers;
+        };
+        std::mutex _mutex;
+        std::condition_variable _jobCv;
+        std::condition_variable _doneCv;
+        std::deque<std::shared_ptr<Job>> _jobs;
+        std::vector<std::thread> _workers;
+        bool _stopping = false;
+
+        void runItems(Job& job) {
+            size_t i;
+            while ((i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.count) {
+                (*job.f)(i);
+                if (job.done.fetch_add(1) + 1 == job.count) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _doneCv.notify_all();
+                }
+            }
+        }
+        void work() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _jobCv.wait(lock, [&]() { return _stopping || !_jobs.empty(); });
+                if (_stopping) return;
+                std::shared_ptr<Job> job = _jobs.front();
+                if (job->helpers > 0) job->helpers--;
+                if (job->helpers == 0 || job->next.load() >= job->count) _jobs.pop_front();
+                lock.unlock();
+                runItems(*job);
+                lock.lock();
+            }
+        }
+    };
+}
+
+void hash_lib::internal::parallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& f) {
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (threads > count) threads = (unsigned int)count;
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) f(i);
+        return;
+    }
+    WorkerPool::instance().run(count, threads, f);
+}
+
+std::vector<FileHashResult> internal::hashFiles(const std::vector<std::string>& paths, unsigned int threads, uint64_t ioBudget, const std::function<bool(const std::string&, std::vector<uint8_t>&)>& hashOne) {
+    std::vector<FileHashResult> results(paths.size());
+    std::vector<size_t> order(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        size_t size;
+        results[i].path = paths[i];
+        if (fileop::get_file_size(paths[i], size)) results[i].size = size;
+        order[i] = i;
+    }
+    // Largest files first, so they do not leave a long tail
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return results[a].size > results[b].size;
+    });
+    if (!ioBudget) ioBudget = 1;
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+    if (threads > paths.size()) threads = (unsigned int)paths.size();
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next = 0;
+    uint64_t inFlight = 0;
+    auto worker = [&]() {
+        while (true) {
+            FileHashResult* result;
+            uint64_t cost;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (next >= order.size()) return;
+                result = &results[order[next++]];
+                cost = result->size < ioBudget ? result->size : ioBudget;
+                cv.wait(lock, [&]() { return inFlight + cost <= ioBudget; });
+                inFlight += cost;
+            }
+            errno = 0;
+            if (!hashOne(result->path, result->digest)) {
+                result->error = errno ? errno : EIO;
+                result->digest.clear();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                inFlight -= cost;
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) t.join();
+    return results;
+}
+
+void internal::PBKDF2Access::iterate(const SHA1& innerKeyed, const SHA1& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations) {
+    // The inner and outer messages are both U after one keyed block, so they share the same padding.
+    uint8_t block[SHA1_BLOCK_SIZE] = { 0 };
+    memcpy(block, u, len);
+    block[len] = 0x80;
+    cstr_write_uint64(block + SHA1_BLOCK_SIZE - 8, (uint64_t)(SHA1_BLOCK_SIZE + len) << 3, 1);
+    SHA1 h;
+    for (uint64_t i = 1; i < iterations; i++) {
+        memcpy(h.state, innerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA1_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 4; j++) cstr_write_uint32(block + j * 4, h.state[j], 1);
+        memcpy(h.state, outerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA1_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 4; j++) cstr_write_uint32(block + j * 4, h.state[j], 1);
+        for (size_t j = 0; j < len; j++) t[j] ^= block[j];
+    }
+    memcpy(u, block, len);
+}
+
+void internal::PBKDF2Access::iterate(const SHA256& innerKeyed, const SHA256& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations) {
+    uint8_t block[SHA256_BLOCK_SIZE] = { 0 };
+    memcpy(block, u, len);
+    block[len] = 0x80;
+    cstr_write_uint64(block + SHA256_BLOCK_SIZE - 8, (uint64_t)(SHA256_BLOCK_SIZE + len) << 3, 1);
+    SHA256 h;
+    for (uint64_t i = 1; i < iterations; i++) {
+        memcpy(h.state, innerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA256_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 4; j++) cstr_write_uint32(block + j * 4, h.state[j], 1);
+        memcpy(h.state, outerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA256_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 4; j++) cstr_write_uint32(block + j * 4, h.state[j], 1);
+        for (size_t j = 0; j < len; j++) t[j] ^= block[j];
+    }
+    memcpy(u, block, len);
+}
+
+void internal::PBKDF2Access::iterate(const SHA512& innerKeyed, const SHA512& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations) {
+    // Only the low half of the 128-bit length field is used
+    uint8_t block[SHA512_BLOCK_SIZE] = { 0 };
+    memcpy(block, u, len);
+    block[len] = 0x80;
+    cstr_write_uint64(block + SHA512_BLOCK_SIZE - 8, (uint64_t)(SHA512_BLOCK_SIZE + len) << 3, 1);
+    SHA512 h;
+    for (uint64_t i = 1; i < iterations; i++) {
+        memcpy(h.state, innerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA512_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 8; j++) cstr_write_uint64(block + j * 8, h.state[j], 1);
+        memcpy(h.state, outerKeyed.state, sizeof(h.state));
+        h.hashBlocks(block, 0, SHA512_BLOCK_SIZE);
+        for (size_t j = 0; j < len / 8; j++) cstr_write_uint64(block + j * 8, h.state[j], 1);
+        for (size_t j = 0; j < len; j++) t[j] ^= block[j];
+    }
+    memcpy(u, block, len);
+}
+
+// Gear table of FastCDC, from splitmix64 so it never changes between versions
+const uint64_t hash_lib::internal::CDC_GEAR[256] = {
+    0xc0e16b163a85a4dcULL, 0x890acd8dd443c47cULL, 0xb3889d8a6dc47761ULL, 0x6a0398e528f0ae6aULL,
+    0x048344ece48a855eULL, 0xf175cfea21871330ULL, 0x391ceef02702c2fdULL, 0x4baf8cac4784cb12ULL,
+    0x3547744583a3f88eULL, 0xd9cf2b15c6b6c90eULL, 0x961facc76d5fe21cULL, 0x0094ab49d50f11f9ULL,
+    0xe3211e37bdbeb6dcULL, 0x62fe6c274ff3511aULL, 0x5ac30b329fdf0574ULL, 0x1450582c6b65b406ULL,
+    0x7a30fcc7888eb791ULL, 0x5540f5ba6a15576eULL, 0x16cef0559096d3e9ULL, 0x2cf8f14b06874899ULL,
+    0xc9c9263b6e2ce103ULL, 0xd6ff920b0a9faa6dULL, 0x53192697db998dc1ULL, 0x73ea9b9bc7cd18d7ULL,
+    0x102713f872c33fceULL, 0xf4183a0e5d2a033eULL, 0x71b63e307eebb517ULL, 0xda61f5713d036000ULL,
+    0x46eb7409ae691b21ULL, 0xb23ad691d6707698ULL, 0x67c8fe11d22fc4b9ULL, 0x7eb4661419481338ULL,
+    0x98077547fb070efcULL, 0x1ee63336c2e3a9a8ULL, 0xbc353656348c36f6ULL, 0xce3898cbf1bb1bd8ULL,
+    0x265b1c23c82915cbULL, 0xfd1948c91687e355ULL, 0xd976893961980ffaULL, 0x336e77a6288e4c34ULL,
+    0x16f8956d7b76d269ULL, 0xda7cd844690d4669ULL, 0x1e8cf85f253a581eULL, 0x3ea68129e923e53aULL,
+    0xa080a077c9e9fd79ULL, 0x4469a19c673c14cfULL, 0xbd5b9351b2d0963cULL, 0xb46a749cad9df6b7ULL,
+    0x07da714e59c7d362ULL, 0x393a84bb5af17618ULL, 0xb3ae08f3c86dfc0cULL, 0x642a350ed7c82c93ULL,
+    0x547bdec029cd3fa3ULL, 0x778debb21b67fc3dULL, 0xb1e26d886eaed22bULL, 0x49fb5996898a7303ULL,
+    0x5e245bcec3e007b3ULL, 0x1f6818e4a739f61bULL, 0xad694562d6313affULL, 0xded7c324e96e3a09ULL,
+    0x0e181ef86a661cf8ULL, 0x675448d833ac146bULL, 0xf047e1b493d6b255ULL, 0xe3d9f8b33d92678cULL,
+    0x62648db4d3b1b3acULL, 0x5e772e6b32ded778ULL, 0x6bc2ea32285bad33ULL, 0x298b58c7b2262c2dULL,
+    0x89a142e7a847c68fULL, 0x07b170d776f29a64ULL, 0x754b9d28182fd07fULL, 0x934990332438604cULL,
+    0xa1ab48a85cc22bbbULL, 0xff5aa2d675545595ULL, 0x32a5a207c5c3eed3ULL, 0xd9970e23aebb3d51ULL,
+    0xd9d01979fc161649ULL, 0x437a2ed7a4fca264ULL, 0x30fa485d263c4dd1ULL, 0xaab6790590cb5b06ULL,
+    0x65091913e11e2cfaULL, 0x51b90f06b259b46bULL, 0x8289d10138b1d6b4ULL, 0x88ae7e8730e361fbULL,
+    0x0833a622304c447bULL, 0xe2e55431bf4b1b54ULL, 0xdde9371fc120d32fULL, 0x5751a8d978ce73ddULL,
+    0xbf1f19e0e1fbd33dULL, 0x75374f1247e3cdaaULL, 0x9f1ca64eb4d3ce97ULL, 0x38136f3a3d5ace59ULL,
+    0xd47963dbf7f8dc43ULL, 0xd87428ff43dd9d86ULL, 0x2607e8bece834053ULL, 0x3c7a84fa12044c87ULL,
+    0x8c7f4bfac5f7e4bbULL, 0xed4a244966996f87ULL, 0x36c97138af16e719ULL, 0x08d81534dedb7662ULL,
+    0xac7c55978241afc4ULL, 0xdf1b8863c9332ce7ULL, 0x620ee7f218ea0997ULL, 0x38d1df383ce89b65ULL,
+    0xe719097929758713ULL, 0x9ec6cd248c58ad3cULL, 0xf54bd98a78d9f340ULL, 0x6498bc6124519df3ULL,
+    0x198e656271e64fa2ULL, 0xa43fd5dd0d813097ULL, 0x35ad65fea929819aULL, 0x2f00139d2a8cd90cULL,
+    0x155f41d97478845cULL, 0x3f2b6a8cfea779b9ULL, 0x4b7264199d7c962aULL, 0xa26165f55b57273fULL,
+    0xb7a6f3f0ecf5b89fULL, 0x8e0692470e1ee509ULL, 0x23234da5964b213aULL, 0x6461d9c18fb4c2b9ULL,
+    0x9c44cac712b73113ULL, 0x93de0e8d937a2da0ULL, 0x88c84529e3843d70ULL, 0x70daad40227330ceULL,
+    0x7ab855c449ec8acaULL, 0xc8de7a81906c8be8ULL, 0x5f5627df47641ddaULL, 0xdd60bf81e2586cbcULL,
+    0x3cfc1ba44eaf2468ULL, 0x405a9309613ad882ULL, 0x4de7eb21b0277f28ULL, 0x86e512678e4dd45aULL,
+    0x0f1286efd6bdd066ULL, 0x1c8aca34c2fa6773ULL, 0x1da8e48b2342e347ULL, 0x1890dcd0a94893e7ULL,
+    0x2b1aaf97ef6b4dffULL, 0xb32b16249647a7ecULL, 0x9fb5f0bced31ea58ULL, 0x3d78f7907627c61fULL,
+    0x1841958c7d191f94ULL, 0xa18a85a96a78b19eULL, 0x631e9abbb0213210ULL, 0x3dab614952cc05a9ULL,
+    0x017020b874beabd6ULL, 0xfa59da85e751094cULL, 0x29cd811450b5412eULL, 0x8d15c850af2489a8ULL,
+    0x950b3bdd58d563a0ULL, 0x836cb8f306d51f7eULL, 0x4065efde02b744e8ULL, 0xb9baecb669369d99ULL,
+    0x7b378c9248d47dc4ULL, 0x4ddd25d48cdc6168ULL, 0xa732d6380105f470ULL, 0x75c8d0927bb9c613ULL,
+    0x6785a012497a2d75ULL, 0xffca85e4ac7617e9ULL, 0xc6f2129203f39492ULL, 0x3ed2bc376029332eULL,
+    0xd0dc8d146f7e2680ULL, 0x513f8ed97341b4a1ULL, 0x4324394cfa366d32ULL, 0x7cbea6ee7da29a4aULL,
+    0x69707125ac82ecfaULL, 0xdd4ba7a8ed6c0ef7ULL, 0x100210a42564a9efULL, 0xaf1101e77e76c1c2ULL,
+    0x140a33b32394451bULL, 0xce3748ebe86fd0f9ULL, 0x763b94236a3c95dcULL, 0x0e82087dbe388ce4ULL,
+    0x8a3f991981c24d6eULL, 0x31b399f558c60586ULL, 0xf50ea2c64afdfe9bULL, 0x6c02449c992ff889ULL,
+    0x7914a6531aeeb744ULL, 0xb75f86f73f2f4ec2ULL, 0x1bdb24c7bd571df8ULL, 0x06e4e518ae8f033eULL,
+    0xffe622dab44f3689ULL, 0xf2792f1385db0e95ULL, 0x2aad6ff4838907b8ULL, 0x0d649d2b9341accaULL,
+    0x2aef8ac693c156cdULL, 0xb86c9e57fa18942eULL, 0xe85e3cf930ed3877ULL, 0xb3fb466dd31f94a2ULL,
+    0xac8d03c007f25604ULL, 0xa9eec498626ff508ULL, 0xf47be033dda3f9b0ULL, 0xa4f748b538e6f27dULL,
+    0xc01bb10959d5e985ULL, 0x89079de7dda37d8fULL, 0xd7007ba815cc0658ULL, 0xc4da1bb45a7b871aULL,
+    0x98185ba52f9d9cd4ULL, 0x4242c91a500844e5ULL, 0x07965f1aa6863c5dULL, 0x0359ccaad9aea599ULL,
+    0xe7a54bf05004eddbULL, 0x333aa1cd725ff5e8ULL, 0x94c18d8184570964ULL, 0xee0303af7e757a57ULL,
+    0xbbc38705003c82ecULL, 0xc57a6bbdbb7edfbdULL, 0xbaea4e697c235ee2ULL, 0x9f1ed9c9b4707ea2ULL,
+    0x3845a969b77941f0ULL, 0x1f02624c80d73ce6ULL, 0x4820b4e1649d1ddcULL, 0x77d1259b2f0be5fbULL,
+    0xa495f4fdba5cccddULL, 0x5ce421e295346c68ULL, 0x0dfd63adc1c5bc74ULL, 0x570045b98cbc93e3ULL,
+    0x5b7317cd17a15f04ULL, 0x6defb13e4a48fa9cULL, 0x9d2540358539f109ULL, 0xdff1d3db7af0541bULL,
+    0xa786c0d906df090eULL, 0x9c8aa8553f5db609ULL, 0x2d5d59b48454ab11ULL, 0x73fbfbfd57360323ULL,
+    0xe045969a1fe274d6ULL, 0xb374b31ccc1c9668ULL, 0xee53c1d82d9ced9cULL, 0x02ee16f7445f3d27ULL,
+    0x43d17009acf06ed8ULL, 0xd17f5baf03dd6e26ULL, 0xbddf2289ed7719ffULL, 0xf9b980d54f117273ULL,
+    0xcdd05dc90b2c3b5bULL, 0xae6df7dd9d557455ULL, 0xa6a0e6779f5dfb3fULL, 0xd85269b48de6f619ULL,
+    0x43b0855155163e1cULL, 0x716aa342eaa75e67ULL, 0xf601d8d15e1709aeULL, 0x9ce1c4f19d6c405bULL,
+    0x8e5d480bf2121c70ULL, 0x5cd643cb24cbaa78ULL, 0x44ecfa2a75ca3a34ULL, 0x390f2eddea3099a2ULL,
+    0xdfea67149da0609fULL, 0xb734297101779a59ULL, 0xc3f3700cbb0afe9fULL, 0x403cae0119d1bb35ULL,
+    0x23853b00d0e1076bULL, 0x63dc284ae4cf5983ULL, 0x252721131cfe91aeULL, 0xdbe6d98b3113e9d6ULL,
+    0xf3f923744c247687ULL, 0x01ef9061730e4ab6ULL, 0x7f2a753307b3391cULL, 0xfd4cbb1b3007d376ULL,
+};
+
+/**
+ * Mask with bits spread over bits 16 to 62 of the gear hash. The upper bits depend on more bytes,
+ * and bit 63 stays clear so the mask can be shifted left by one for two-byte steps.
+ */
+static uint64_t cdcMask(int bits) {
+    if (bits < 1) bits = 1;
+    if (bits > 47) bits = 47;
+    uint64_t mask = 0;
+    for (int k = 0; k < bits; k++) {
+        mask |= 1ULL << (62 - k * 47 / bits);
+    }
+    return mask;
+}
+
+FastCDC::FastCDC(size_t minSize, size_t avgSize, size_t maxSize, int normalization) {
+    int bits = 0;
+    while (bits < 47 && ((size_t)2 << bits) <= avgSize) bits++;
+    _avgSize = (size_t)1 << bits;
+    _minSize = minSize < _avgSize ? minSize : _avgSize;
+    _maxSize = maxSize > _avgSize ? maxSize : _avgSize;
+    if (normalization < 0) normalization = 0;
+    _maskS = cdcMask(bits + normalization);
+    _maskL = cdcMask(bits - normalization);
+}
+
+// CDC_GEAR shifted left by one, for the first byte of each two-byte step
+static struct CDCGearShifted {
+    uint64_t table[256];
+    CDCGearShifted() {
+        for (int i = 0; i < 256; i++) table[i] = internal::CDC_GEAR[i] << 1;
+    }
+} cdcGearShifted;
+
+/**
+ * Scan [i, end) with the gear hash fp and mask, 2 bytes per step.
+ * The hash is kept shifted left by one after the first byte of a step, so it is tested with the shifted mask.
+ * @return Length of the chunk if a boundary is found, otherwise 0 with fp and i at the end
+ */
+static inline size_t cdcScan(const uint8_t* data, size_t& i, size_t end, uint64_t& fp, uint64_t mask) {
+    const uint64_t* gear = internal::CDC_GEAR;
+    const uint64_t* gearLs = cdcGearShifted.table;
+    uint64_t maskLs = mask << 1;
+    uint64_t h = fp;
+    size_t j = i;
+    for (; j + 4 <= end; j += 4) {
+        h = (h << 2) + gearLs[data[j]];
+        if (!(h & maskLs)) return j + 1;
+        h += gear[data[j + 1]];
+        if (!(h & mask)) return j + 2;
+        h = (h << 2) + gearLs[data[j + 2]];
+        if (!(h & maskLs)) return j + 3;
+        h += gear[data[j + 3]];
+        if (!(h & mask)) return j + 4;
+    }
+    for (; j < end; j++) {
+        h = (h << 1) + gear[data[j]];
+        if (!(h & mask)) return j + 1;
+    }
+    fp = h;
+    i = j;
+    return 0;
+}
+
+size_t FastCDC::cut(const uint8_t* data, size_t len) const {
+    if (len <= _minSize) return len;
+    size_t end = len < _maxSize ? len : _maxSize;
+    size_t center = end < _avgSize ? end : _avgSize;
+    uint64_t fp = 0;
+    size_t i = _minSize;
+    size_t re = cdcScan(data, i, center, fp, _maskS);
+    if (!re) re = cdcScan(data, i, end, fp, _maskL);
+    return re ? re : end;
+}
@@ -3,11 +3,22 @@
 #include <stdint.h>
 #include <stdio.h>
 #ifdef __cplusplus
+#include <array>
+#include <atomic>
+#include <functional>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <string.h>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 #include "fileop.h"
+#include "stream.h"
 namespace hash_lib {
+    namespace internal {
+        struct PBKDF2Access;
+    }
     class Hash {
     public:
         /**
@@ -42,6 +53,24 @@ namespace hash_lib {
          * @return this
          */
         Hash* update(FILE* f);
+        /**
+         * Update the hash with the content of a file, read in large chunks.
+         * @param filePath File path
+         * @param mapped Hash regular files in place through memory maps (in windows of up to 1 GiB). Faster on
+         * page-cached files, but truncating the file or an I/O error while it is hashed raises SIGBUS.
+         * @return false if the file can not be opened or read
+         */
+        bool updateFile(const std::string& filePath, bool mapped = false);
+        /**
+         * Update the hash with the content of a file, reading on a separate thread.
+         * The reader fills the next buffers while the current one is being hashed,
+         * so read latency is hidden behind hashing on slow or cold storage.
+         * @param filePath File path
+         * @param bufferSize Size of each buffer
+         * @param queueDepth Count of buffers which can be filled ahead of the hasher
+         * @return false if the file can not be opened or read
+         */
+        bool updateFilePipelined(const std::string& filePath, size_t bufferSize = 4 << 20, size_t queueDepth = 2);
         /**
          * Reset the hash
          * @return this
@@ -80,9 +109,39 @@ namespace hash_lib {
          * @return The hash result in hex format
          */
         std::string hexDigest();
+        /**
+         * Finish the hash and write the result in hex format without allocating
+         * (except for digests longer than 64 bytes)
+         * @param output Buffer of at least digestLength() * 2 + 1 chars, the result is null terminated
+         * @param len Length of the buffer
+         * @return false if the buffer is too small, the hash is not finished then
+         */
+        bool hexDigest(char* output, size_t len);
+        /**
+         * Export the intermediate state, so hashing can be resumed later (e.g. after a restart) with importState().
+         * The blob is versioned, checksummed and independent of the platform.
+         * @return The state, empty if the hash is finished or does not support it
+         */
+        virtual std::vector<uint8_t> exportState();
+        /**
+         * Restore a state exported by exportState() of the same algorithm
+         * @param data State
+         * @param len Length of the state
+         * @return false if the state is invalid or from another algorithm, the hash is unchanged then
+         */
+        virtual bool importState(const uint8_t* data, size_t len);
+        bool importState(const std::vector<uint8_t>& data);
+    protected:
+        /**
+         * Largest read of update(FILE*) and updateFile, hashes which split large inputs across threads want more
+         */
+        virtual size_t fileReadSize();
     };
     class SHA512: public Hash {
+        friend struct internal::PBKDF2Access;
     public:
+        static constexpr size_t DIGEST_LENGTH = 64;
+        static constexpr size_t BLOCK_SIZE = 128;
         SHA512();
         virtual int digestLength() override;
         int blockSize() override;
@@ -92,13 +151,14 @@ namespace hash_lib {
         Hash* finish(uint8_t* data, size_t len) override;
         using Hash::finish;
         void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
     protected:
-        uint32_t stateHi[8];
-        uint32_t stateLo[8];
+        uint64_t state[8];
         virtual void _initState();
     private:
-        uint32_t _tempHi[16];
-        uint32_t _tempLo[16];
+        uint64_t _temp[80];
         uint8_t _buffer[256];
         size_t _bufferLength = 0;
         size_t _bytesHashed = 0;
@@ -107,6 +167,8 @@ namespace hash_lib {
     };
     class SHA512_256: public SHA512 {
     public:
+        static constexpr size_t DIGEST_LENGTH = 32;
+        static constexpr size_t BLOCK_SIZE = 128;
         SHA512_256();
         int digestLength() override;
     protected:
@@ -114,13 +176,18 @@ namespace hash_lib {
     };
     class SHA384: public SHA512 {
     public:
+        static constexpr size_t DIGEST_LENGTH = 48;
+        static constexpr size_t BLOCK_SIZE = 128;
         SHA384();
         int digestLength() override;
     protected:
         void _initState() override;
     };
     class SHA256: public Hash {
+        friend struct internal::PBKDF2Access;
     public:
+        static constexpr size_t DIGEST_LENGTH = 32;
+        static constexpr size_t BLOCK_SIZE = 64;
         SHA256();
         virtual int digestLength() override;
         int blockSize() override;
@@ -130,6 +197,9 @@ namespace hash_lib {
         Hash* finish(uint8_t* data, size_t len) override;
         using Hash::finish;
         void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
     protected:
         uint32_t state[8];
         virtual void _initState();
@@ -143,13 +213,18 @@ namespace hash_lib {
     };
     class SHA224: public SHA256 {
     public:
+        static constexpr size_t DIGEST_LENGTH = 28;
+        static constexpr size_t BLOCK_SIZE = 64;
         SHA224();
         int digestLength() override;
     protected:
         void _initState() override;
     };
     class SHA1: public Hash {
+        friend struct internal::PBKDF2Access;
     public:
+        static constexpr size_t DIGEST_LENGTH = 20;
+        static constexpr size_t BLOCK_SIZE = 64;
         SHA1();
         virtual int digestLength() override;
         int blockSize() override;
@@ -159,6 +234,9 @@ namespace hash_lib {
         Hash* finish(uint8_t* data, size_t len) override;
         using Hash::finish;
         void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
     protected:
         uint32_t state[5];
         virtual void _initState();
@@ -172,6 +250,8 @@ namespace hash_lib {
     };
     class MD5: public Hash {
     public:
+        static constexpr size_t DIGEST_LENGTH = 16;
+        static constexpr size_t BLOCK_SIZE = 64;
         MD5();
         virtual int digestLength() override;
         int blockSize() override;
@@ -181,6 +261,9 @@ namespace hash_lib {
         Hash* finish(uint8_t* data, size_t len) override;
         using Hash::finish;
         void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
     protected:
         uint32_t state[4];
         virtual void _initState();
@@ -192,18 +275,370 @@ namespace hash_lib {
         bool _finished = false;
         size_t hashBlocks(const uint8_t* m, size_t pos, size_t len);
     };
+    /**
+     * BLAKE3 hash.
+     * Whole chunks are compressed several at a time with SIMD (AVX2 or AVX-512) when available,
+     * large inputs can also be split across multiple threads.
+     */
+    class BLAKE3: public Hash {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 32;
+        static constexpr size_t BLOCK_SIZE = 64;
+        BLAKE3();
+        /**
+         * @param threads Maximum count of threads used to hash a large input passed to update(), 0 means all cores.
+         * The threads belong to a pool shared by all hashes and started once. updateFile reads larger chunks then.
+         */
+        explicit BLAKE3(unsigned int threads);
+        virtual int digestLength() override;
+        int blockSize() override;
+        Hash* update(const uint8_t* data, size_t len) override;
+        using Hash::update;
+        Hash* reset() override;
+        /**
+         * Finish the hash and return the result.
+         * BLAKE3 is an extendable output function, all len bytes of data are filled.
+         * @param data Buffer to store the result
+         * @param len Length of the buffer
+         * @return this
+         */
+        Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
+        /**
+         * Set the maximum count of threads used to hash a large input passed to update()
+         * @param threads Count of threads, 0 means all cores
+         * @return this
+         */
+        BLAKE3* setThreads(unsigned int threads);
+    protected:
+        size_t fileReadSize() override;
+    private:
+        uint32_t _key[8];
+        uint8_t _flags = 0;
+        unsigned int _threads = 1;
+        // Chaining values of the completed subtrees, merged lazily.
+        uint8_t _cvStack[54 * 32];
+        size_t _cvStackLength = 0;
+        // Current chunk
+        uint32_t _chunkCv[8];
+        uint64_t _chunkCounter = 0;
+        uint8_t _buffer[64];
+        size_t _bufferLength = 0;
+        size_t _blocksCompressed = 0;
+        bool _finished = false;
+        size_t chunkLength();
+        void chunkUpdate(const uint8_t* data, size_t len);
+        void chunkReset(uint64_t counter);
+        void pushCv(const uint8_t cv[32], uint64_t chunkCounter);
+        void mergeCvStack(uint64_t totalChunks);
+    };
+    /**
+     * CRC-32 checksum (zlib, PNG, Ethernet), folded with PCLMULQDQ or computed with ARMv8 crc32 instructions when available.
+     * The digest is the checksum in big endian.
+     */
+    class CRC32: public Hash {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 4;
+        static constexpr size_t BLOCK_SIZE = 1;
+        CRC32();
+        virtual int digestLength() override;
+        int blockSize() override;
+        Hash* update(const uint8_t* data, size_t len) override;
+        using Hash::update;
+        Hash* reset() override;
+        Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
+        /**
+         * @return The checksum of the data so far
+         */
+        uint32_t value();
+        /**
+         * Combine the checksums of two adjacent pieces of data, so pieces can be checksummed in parallel
+         * @param crc1 Checksum of the first piece
+         * @param crc2 Checksum of the second piece
+         * @param len2 Length of the second piece
+         * @return The checksum of the first piece followed by the second piece
+         */
+        static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+    private:
+        uint32_t _crc;
+        bool _finished = false;
+    };
+    /**
+     * CRC-32C (Castagnoli) checksum (iSCSI, ext4, SCTP), computed with the SSE4.2 or ARMv8 crc32c instructions when available.
+     * The digest is the checksum in big endian.
+     */
+    class CRC32C: public Hash {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 4;
+        static constexpr size_t BLOCK_SIZE = 1;
+        CRC32C();
+        virtual int digestLength() override;
+        int blockSize() override;
+        Hash* update(const uint8_t* data, size_t len) override;
+        using Hash::update;
+        Hash* reset() override;
+        Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
+        /**
+         * @return The checksum of the data so far
+         */
+        uint32_t value();
+        /**
+         * Combine the checksums of two adjacent pieces of data, so pieces can be checksummed in parallel
+         * @param crc1 Checksum of the first piece
+         * @param crc2 Checksum of the second piece
+         * @param len2 Length of the second piece
+         * @return The checksum of the first piece followed by the second piece
+         */
+        static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+    private:
+        uint32_t _crc;
+        bool _finished = false;
+    };
+    /**
+     * SHA-3 family (FIPS 202), a sponge over the Keccak-f[1600] permutation.
+     * blockSize() is the rate of the sponge, so HMAC works with every member of the family.
+     */
+    class SHA3: public Hash {
+    public:
+        virtual int digestLength() override;
+        int blockSize() override;
+        Hash* update(const uint8_t* data, size_t len) override;
+        using Hash::update;
+        Hash* reset() override;
+        Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
+    protected:
+        /**
+         * @param rate Rate of the sponge in bytes
+         * @param digestLength Length of the digest in bytes
+         * @param xof Whether finish() can output any length (SHAKE)
+         */
+        SHA3(int rate, int digestLength, bool xof);
+    private:
+        uint64_t _state[25];
+        uint8_t _buffer[168];
+        size_t _bufferLength = 0;
+        int _rate;
+        int _digestLength;
+        bool _xof;
+        bool _finished = false;
+    };
+    class SHA3_224: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 28;
+        static constexpr size_t BLOCK_SIZE = 144;
+        SHA3_224();
+    };
+    class SHA3_256: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 32;
+        static constexpr size_t BLOCK_SIZE = 136;
+        SHA3_256();
+    };
+    class SHA3_384: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 48;
+        static constexpr size_t BLOCK_SIZE = 104;
+        SHA3_384();
+    };
+    class SHA3_512: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 64;
+        static constexpr size_t BLOCK_SIZE = 72;
+        SHA3_512();
+    };
+    /**
+     * SHAKE128 extendable-output function, finish() fills the whole buffer
+     */
+    class SHAKE128: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 32;
+        static constexpr size_t BLOCK_SIZE = 168;
+        SHAKE128();
+        /**
+         * @param digestLength Length of digest() (32 bytes by default)
+         */
+        explicit SHAKE128(int digestLength);
+    };
+    /**
+     * SHAKE256 extendable-output function, finish() fills the whole buffer
+     */
+    class SHAKE256: public SHA3 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 64;
+        static constexpr size_t BLOCK_SIZE = 136;
+        SHAKE256();
+        /**
+         * @param digestLength Length of digest() (64 bytes by default)
+         */
+        explicit SHAKE256(int digestLength);
+    };
+    /**
+     * 128-bit XXH3 hash value
+     */
+    struct XXH128Value {
+        uint64_t low;
+        uint64_t high;
+        bool operator==(const XXH128Value& other) const {
+            return low == other.low && high == other.high;
+        }
+        bool operator!=(const XXH128Value& other) const {
+            return !(*this == other);
+        }
+    };
+    /**
+     * XXH3 64-bit hash (non-cryptographic), accumulated with SSE2, AVX2 or NEON when available.
+     * The digest is the hash in big endian (the canonical form of xxHash).
+     */
+    class XXH3_64: public Hash {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 8;
+        static constexpr size_t BLOCK_SIZE = 64;
+        XXH3_64();
+        /**
+         * @param seed Seed of the hash
+         */
+        explicit XXH3_64(uint64_t seed);
+        virtual int digestLength() override;
+        int blockSize() override;
+        Hash* update(const uint8_t* data, size_t len) override;
+        using Hash::update;
+        Hash* reset() override;
+        virtual Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        void clean() override;
+        std::vector<uint8_t> exportState() override;
+        bool importState(const uint8_t* data, size_t len) override;
+        using Hash::importState;
+        /**
+         * @return The hash of the data so far
+         */
+        uint64_t value();
+    protected:
+        uint64_t _seed;
+        uint64_t _acc[8];
+        uint8_t _secret[192];
+        // Always keeps 1 to 256 bytes after the first update, the last 64 bytes keep the last consumed stripe
+        uint8_t _buffer[256];
+        size_t _bufferLength;
+        size_t _stripesSoFar;
+        uint64_t _totalLength;
+        bool _finished = false;
+        /**
+         * Accumulate the buffered data and the last stripe into acc (only used when more than 240 bytes were hashed)
+         */
+        void digestLong(uint64_t acc[8]);
+    };
+    /**
+     * XXH3 128-bit hash (XXH128), the digest is the high 64 bits followed by the low 64 bits in big endian.
+     */
+    class XXH3_128: public XXH3_64 {
+    public:
+        static constexpr size_t DIGEST_LENGTH = 16;
+        static constexpr size_t BLOCK_SIZE = 64;
+        XXH3_128();
+        /**
+         * @param seed Seed of the hash
+         */
+        explicit XXH3_128(uint64_t seed);
+        int digestLength() override;
+        Hash* finish(uint8_t* data, size_t len) override;
+        using Hash::finish;
+        /**
+         * @return The hash of the data so far
+         */
+        XXH128Value value();
+    };
+    /**
+     * Compute XXH3 64-bit hash in one shot
+     * @param data Data
+     * @param len Length of the data
+     * @param seed Seed
+     */
+    uint64_t xxh3Hash64(const void* data, size_t len, uint64_t seed = 0);
+    /**
+     * Compute XXH3 128-bit hash in one shot
+     * @param data Data
+     * @param len Length of the data
+     * @param seed Seed
+     */
+    XXH128Value xxh3Hash128(const void* data, size_t len, uint64_t seed = 0);
+    /**
+     * Stateless hash functor based on XXH3, can be used in place of std::hash (e.g. hash_map_new<std::string, int, hash_lib::XXH3Hasher>).
+     * Strings are hashed by their content, integers, enums and other pointers are hashed by their bytes.
+     */
+    struct XXH3Hasher {
+        size_t operator()(const std::string& s) const {
+            return (size_t)xxh3Hash64(s.data(), s.size());
+        }
+        size_t operator()(const char* s) const {
+            return (size_t)xxh3Hash64(s, strlen(s));
+        }
+        // Strings too, not the pointer as for other pointer types
+        size_t operator()(char* s) const {
+            return (*this)((const char*)s);
+        }
+        size_t operator()(const std::vector<uint8_t>& v) const {
+            return (size_t)xxh3Hash64(v.data(), v.size());
+        }
+#if __cplusplus >= 201703L
+        size_t operator()(std::string_view s) const {
+            return (size_t)xxh3Hash64(s.data(), s.size());
+        }
+#endif
+        template <typename T, typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value, int>::type = 0>
+        size_t operator()(T v) const {
+            return (size_t)xxh3Hash64(&v, sizeof(T));
+        }
+    };
+    /**
+     * HMAC based on any hash.
+     * The hash states after absorbing the inner and outer pads are computed once in the constructor,
+     * reset() only copies the inner state back, so reusing the same key is cheap.
+     */
     template<class H>
     class HMAC: public Hash {
     public:
+        static constexpr size_t DIGEST_LENGTH = H::DIGEST_LENGTH;
+        static constexpr size_t BLOCK_SIZE = H::BLOCK_SIZE;
         HMAC(const uint8_t* key, size_t len) {
-            int blockSize = _outer.blockSize();
-            std::vector<uint8_t> pad(blockSize);
+            size_t blockSize = _innerKeyed.blockSize();
+            size_t digestLength = _inner.digestLength();
+            // The digest of a long key can be longer than a block (CRC32), only the first block is used
+            std::vector<uint8_t> pad(blockSize > digestLength ? blockSize : digestLength);
             if (len > blockSize) {
-                _inner.update(key, len)->finish(pad)->clean();
-            } else {
+                // Only digestLength() bytes, extendable-output hashes would fill the whole pad
+                _inner.update(key, len)->finish(pad.data(), digestLength)->clean();
+            } else if (len) {
                 memcpy(pad.data(), key, len);
             }
-            _pad = std::move(pad);
+            for (size_t i = 0; i < blockSize; i++) {
+                pad[i] ^= 0x36;
+            }
+            _innerKeyed.update(pad.data(), blockSize);
+            for (size_t i = 0; i < blockSize; i++) {
+                pad[i] ^= 0x36 ^ 0x5c;
+            }
+            _outerKeyed.update(pad.data(), blockSize);
+            memset(pad.data(), 0, pad.size());
             reset();
         }
         HMAC(const std::string& key) : HMAC((const uint8_t*)key.c_str(), key.size()) {}
@@ -211,26 +646,15 @@ namespace hash_lib {
         template <size_t T>
         HMAC(const uint8_t (&key)[T]) : HMAC(key, T) {}
         Hash* reset() override {
-            _inner.clean();
-            _outer.clean();
-            int blockSize = _outer.blockSize();
-            auto pad(_pad);
-            for (int i = 0; i < blockSize; i++) {
-                pad[i] ^= 0x36;
-            }
-            _inner.update(pad);
-            for (int i = 0; i < blockSize; i++) {
-                pad[i] ^= 0x36 ^ 0x5c;
-            }
-            _outer.update(pad);
+            _inner = _innerKeyed;
             _finished = false;
             return this;
         }
         int digestLength() override {
-            return _outer.digestLength();
+            return _outerKeyed.digestLength();
         }
         int blockSize() override {
-            return _outer.blockSize();
+            return _outerKeyed.blockSize();
         }
         Hash* update(const uint8_t* data, size_t len) override {
             _inner.update(data, len);
@@ -242,20 +666,186 @@ namespace hash_lib {
                 _outer.finish(data, len);
                 return this;
             }
-            _outer.update(_inner.digest())->finish(data, len);
+            uint8_t innerDigest[HMAC_MAX_INNER_DIGEST];
+            size_t innerLength = _inner.digestLength();
+            _outer = _outerKeyed;
+            if (innerLength <= sizeof(innerDigest)) {
+                _inner.finish(innerDigest, innerLength);
+                _outer.update(innerDigest, innerLength);
+            } else {
+                _outer.update(_inner.digest());
+            }
+            _outer.finish(data, len);
             _finished = true;
             return this;
         }
         using Hash::finish;
         void clean() override {
+            _inner.clean();
+            _outer.clean();
             reset();
         }
+        /**
+         * @return Hash state right after the inner pad, every message starts from it
+         */
+        const H& innerKeyed() const {
+            return _innerKeyed;
+        }
+        /**
+         * @return Hash state right after the outer pad
+         */
+        const H& outerKeyed() const {
+            return _outerKeyed;
+        }
     private:
+        // Largest digest of the default constructed hashes, longer ones are finished into a vector
+        static const size_t HMAC_MAX_INNER_DIGEST = 64;
         H _inner;
         H _outer;
-        std::vector<uint8_t> _pad;
-        bool _finished = false; 
+        H _innerKeyed;
+        H _outerKeyed;
+        bool _finished = false;
     };
+    namespace internal {
+        /**
+         * Run the PBKDF2 iterations of the SHA-1 and SHA-2 family directly on their compression function.
+         * U is kept inside a pre-padded block, so every iteration is exactly two compressions.
+         */
+        struct PBKDF2Access {
+            static void iterate(const SHA1& innerKeyed, const SHA1& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations);
+            static void iterate(const SHA256& innerKeyed, const SHA256& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations);
+            static void iterate(const SHA512& innerKeyed, const SHA512& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations);
+        };
+        template<class H>
+        void pbkdf2Iterate(const H& innerKeyed, const H& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations, std::true_type) {
+            PBKDF2Access::iterate(innerKeyed, outerKeyed, u, t, len, iterations);
+        }
+        template<class H>
+        void pbkdf2Iterate(const H& innerKeyed, const H& outerKeyed, uint8_t* u, uint8_t* t, size_t len, uint64_t iterations, std::false_type) {
+            H h;
+            for (uint64_t i = 1; i < iterations; i++) {
+                h = innerKeyed;
+                h.update(u, len)->finish(u, len);
+                h = outerKeyed;
+                h.update(u, len)->finish(u, len);
+                for (size_t j = 0; j < len; j++) {
+                    t[j] ^= u[j];
+                }
+            }
+        }
+        /**
+         * Call f(0) ... f(count - 1), spread over up to threads threads (0 means all cores)
+         */
+        void parallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& f);
+    }
+    /**
+     * PBKDF2 (RFC 8018) with HMAC<H> as the pseudorandom function.
+     * The key is padded once, the iterations of SHA-1 and SHA-2 run directly on the compression function,
+     * and output blocks are derived in parallel when more than one block is requested.
+     * @param password Password
+     * @param passwordLen Length of the password
+     * @param salt Salt
+     * @param saltLen Length of the salt
+     * @param iterations Count of iterations, at least 1
+     * @param keyLength Length of the derived key, at most (2^32 - 1) * digestLength() bytes
+     * @param threads Maximum count of threads, 0 means all cores
+     * @return Derived key, empty if iterations is 0 or keyLength is too long
+     */
+    template<class H>
+    std::vector<uint8_t> pbkdf2(const uint8_t* password, size_t passwordLen, const uint8_t* salt, size_t saltLen, uint64_t iterations, size_t keyLength, unsigned int threads = 0) {
+        if (!iterations) return {};
+        HMAC<H> prf(password, passwordLen);
+        size_t hLen = prf.digestLength();
+        size_t blocks = keyLength / hLen + (keyLength % hLen != 0);
+        // The block index is a 32-bit counter (RFC 8018 section 5.2)
+        if ((uint64_t)blocks > 0xffffffffull) return {};
+        std::vector<uint8_t> out(blocks * hLen);
+        typedef std::integral_constant<bool, std::is_base_of<SHA1, H>::value || std::is_base_of<SHA256, H>::value || std::is_base_of<SHA512, H>::value> hasBlockIterate;
+        internal::parallelFor(blocks, threads, [&](size_t block) {
+            HMAC<H> h(prf);
+            uint8_t index[4];
+            uint32_t i = (uint32_t)block + 1;
+            index[0] = (uint8_t)(i >> 24);
+            index[1] = (uint8_t)(i >> 16);
+            index[2] = (uint8_t)(i >> 8);
+            index[3] = (uint8_t)i;
+            std::vector<uint8_t> u(hLen);
+            uint8_t* t = out.data() + block * hLen;
+            h.update(salt, saltLen)->update(index, 4)->finish(u.data(), hLen);
+            memcpy(t, u.data(), hLen);
+            internal::pbkdf2Iterate<H>(prf.innerKeyed(), prf.outerKeyed(), u.data(), t, hLen, iterations, hasBlockIterate());
+        });
+        out.resize(keyLength);
+        return out;
+    }
+    template<class H>
+    std::vector<uint8_t> pbkdf2(const std::string& password, const std::string& salt, uint64_t iterations, size_t keyLength, unsigned int threads = 0) {
+        return pbkdf2<H>((const uint8_t*)password.c_str(), password.size(), (const uint8_t*)salt.c_str(), salt.size(), iterations, keyLength, threads);
+    }
+    /**
+     * HKDF-Extract (RFC 5869)
+     * @param salt Salt, an empty salt means digestLength() zero bytes
+     * @param saltLen Length of the salt
+     * @param ikm Input keying material
+     * @param ikmLen Length of the input keying material
+     * @return Pseudorandom key
+     */
+    template<class H>
+    std::vector<uint8_t> hkdfExtract(const uint8_t* salt, size_t saltLen, const uint8_t* ikm, size_t ikmLen) {
+        // HMAC pads a short key with zeros, so an empty salt already acts as digestLength() zero bytes.
+        HMAC<H> h(salt, saltLen);
+        h.update(ikm, ikmLen);
+        return h.digest();
+    }
+    /**
+     * HKDF-Expand (RFC 5869).
+     * Every block depends on the previous one, the keyed states of the pseudorandom key are reused between blocks.
+     * @param prk Pseudorandom key
+     * @param prkLen Length of the pseudorandom key
+     * @param info Context information
+     * @param infoLen Length of the context information
+     * @param length Length of the output, at most 255 * digestLength()
+     * @return Output keying material, empty if length is too large
+     */
+    template<class H>
+    std::vector<uint8_t> hkdfExpand(const uint8_t* prk, size_t prkLen, const uint8_t* info, size_t infoLen, size_t length) {
+        HMAC<H> h(prk, prkLen);
+        size_t hLen = h.digestLength();
+        if (length > 255 * hLen) return {};
+        size_t blocks = (length + hLen - 1) / hLen;
+        std::vector<uint8_t> out(blocks * hLen);
+        for (size_t i = 0; i < blocks; i++) {
+            uint8_t counter = (uint8_t)(i + 1);
+            h.reset();
+            if (i) h.update(out.data() + (i - 1) * hLen, hLen);
+            h.update(info, infoLen)->update(&counter, 1)->finish(out.data() + i * hLen, hLen);
+        }
+        out.resize(length);
+        return out;
+    }
+    /**
+     * HKDF (RFC 5869), extract then expand
+     * @return Output keying material, empty if length is larger than 255 * digestLength()
+     */
+    template<class H>
+    std::vector<uint8_t> hkdf(const uint8_t* ikm, size_t ikmLen, const uint8_t* salt, size_t saltLen, const uint8_t* info, size_t infoLen, size_t length) {
+        auto prk = hkdfExtract<H>(salt, saltLen, ikm, ikmLen);
+        return hkdfExpand<H>(prk.data(), prk.size(), info, infoLen, length);
+    }
+    template<class H>
+    std::vector<uint8_t> hkdf(const std::string& ikm, const std::string& salt, const std::string& info, size_t length) {
+        return hkdf<H>((const uint8_t*)ikm.c_str(), ikm.size(), (const uint8_t*)salt.c_str(), salt.size(), (const uint8_t*)info.c_str(), info.size(), length);
+    }
+    /**
+     * Enable or disable hardware accelerated implementations (SHA-NI, ARMv8 crypto, ...).
+     * They are enabled by default and only used when the CPU supports them.
+     * @param enabled Whether to use hardware implementations
+     */
+    void setHardwareAcceleration(bool enabled);
+    /**
+     * @return Whether hardware accelerated implementations are enabled
+     */
+    bool hardwareAcceleration();
     template<class H, typename ... Args>
     std::vector<uint8_t> hash(const uint8_t* data, size_t len, Args... args) {
         H h(args...);
@@ -280,12 +870,329 @@ namespace hash_lib {
         h.update(data);
         return h.digest();
     }
+    /**
+     * Digest of H with a size known at compile time.
+     * Every algorithm exposes DIGEST_LENGTH and BLOCK_SIZE as constants (extendable-output hashes use their default length).
+     */
+    template<class H>
+    using Digest = std::array<uint8_t, H::DIGEST_LENGTH>;
+    /**
+     * Finish a hash of a known type into a std::array.
+     * The calls are qualified with H, so they are not dispatched through the virtual table.
+     * @param h Hash
+     * @return Digest
+     */
+    template<class H>
+    Digest<H> finishDigest(H& h) {
+        Digest<H> out;
+        h.H::finish(out.data(), out.size());
+        return out;
+    }
+    /**
+     * Hash data without heap allocation (for hashes whose state does not allocate) and without virtual calls
+     * @param data Data
+     * @param len Length of the data
+     * @return Digest
+     */
+    template<class H, typename ... Args>
+    Digest<H> hashDigest(const uint8_t* data, size_t len, Args... args) {
+        H h(args...);
+        h.H::update(data, len);
+        return finishDigest(h);
+    }
+    template<class H, typename ... Args>
+    Digest<H> hashDigest(const std::string& data, Args... args) {
+        return hashDigest<H>((const uint8_t*)data.c_str(), data.size(), args...);
+    }
+    template<class H, typename ... Args>
+    Digest<H> hashDigest(const std::vector<uint8_t>& data, Args... args) {
+        return hashDigest<H>(data.data(), data.size(), args...);
+    }
+#if __cplusplus >= 201703L
+    namespace internal {
+        // Tables of the constexpr implementations, the runtime ones live in hash_lib.cpp
+        struct ConstexprTables {
+            static constexpr uint32_t SHA256_K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+            };
+            static constexpr uint32_t MD5_K[64] = {
+                0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+                0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+                0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+                0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+                0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+                0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+                0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+                0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+            };
+            static constexpr int MD5_SHIFT[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+        };
+        constexpr uint32_t constexprRotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+        /**
+         * Byte of a Merkle-Damgard padded message: data, 0x80, zeros, then the bit length in the last 8 bytes
+         * @param paddedLen Length of the padded message
+         * @param bigEndian Whether the bit length is stored in big endian
+         */
+        constexpr uint8_t constexprPaddedByte(std::string_view data, uint64_t pos, uint64_t paddedLen, bool bigEndian) {
+            if (pos < data.size()) return (uint8_t)data[pos];
+            if (pos == data.size()) return 0x80;
+            if (pos + 8 < paddedLen) return 0;
+            uint64_t bits = (uint64_t)data.size() << 3;
+            uint64_t i = pos + 8 - paddedLen;
+            return (uint8_t)(bits >> (bigEndian ? (7 - i) * 8 : i * 8));
+        }
+    }
+    /**
+     * SHA-256 which can be evaluated at compile time, e.g. static_assert(hexEquals(sha256Constexpr("abc"), "ba7816bf..."))
+     * @param data Data
+     * @return Digest, the same as hashDigest<SHA256>(data)
+     */
+    constexpr Digest<SHA256> sha256Constexpr(std::string_view data) {
+        uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        uint64_t paddedLen = (data.size() + 9 + 63) / 64 * 64;
+        for (uint64_t block = 0; block < paddedLen; block += 64) {
+            uint32_t w[64] = {};
+            for (int i = 0; i < 16; i++) {
+                for (int j = 0; j < 4; j++) {
+                    w[i] = (w[i] << 8) | internal::constexprPaddedByte(data, block + i * 4 + j, paddedLen, true);
+                }
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = internal::constexprRotr(w[i - 15], 7) ^ internal::constexprRotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = internal::constexprRotr(w[i - 2], 17) ^ internal::constexprRotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t t1 = h + (internal::constexprRotr(e, 6) ^ internal::constexprRotr(e, 11) ^ internal::constexprRotr(e, 25)) + ((e & f) ^ (~e & g)) + internal::ConstexprTables::SHA256_K[i] + w[i];
+                uint32_t t2 = (internal::constexprRotr(a, 2) ^ internal::constexprRotr(a, 13) ^ internal::constexprRotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+        Digest<SHA256> out = {};
+        for (int i = 0; i < 32; i++) out[i] = (uint8_t)(state[i / 4] >> (24 - (i % 4) * 8));
+        return out;
+    }
+    /**
+     * MD5 which can be evaluated at compile time
+     * @param data Data
+     * @return Digest, the same as hashDigest<MD5>(data)
+     */
+    constexpr Digest<MD5> md5Constexpr(std::string_view data) {
+        uint32_t state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+        uint64_t paddedLen = (data.size() + 9 + 63) / 64 * 64;
+        for (uint64_t block = 0; block < paddedLen; block += 64) {
+            uint32_t m[16] = {};
+            for (int i = 0; i < 16; i++) {
+                for (int j = 3; j >= 0; j--) {
+                    m[i] = (m[i] << 8) | internal::constexprPaddedByte(data, block + i * 4 + j, paddedLen, false);
+                }
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            for (int i = 0; i < 64; i++) {
+                uint32_t f = 0;
+                int g = 0;
+                if (i < 16) {
+                    f = (b & c) | (~b & d);
+                    g = i;
+                } else if (i < 32) {
+                    f = (d & b) | (~d & c);
+                    g = (5 * i + 1) % 16;
+                } else if (i < 48) {
+                    f = b ^ c ^ d;
+                    g = (3 * i + 5) % 16;
+                } else {
+                    f = c ^ (b | ~d);
+                    g = (7 * i) % 16;
+                }
+                uint32_t t = a + f + internal::ConstexprTables::MD5_K[i] + m[g];
+                a = d;
+                d = c;
+                c = b;
+                b = b + internal::constexprRotr(t, 32 - internal::ConstexprTables::MD5_SHIFT[i / 16][i % 4]);
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+        }
+        Digest<MD5> out = {};
+        for (int i = 0; i < 16; i++) out[i] = (uint8_t)(state[i / 4] >> ((i % 4) * 8));
+        return out;
+    }
+    /**
+     * CRC-32 which can be evaluated at compile time, bit by bit
+     * @param data Data
+     * @param crc Checksum of the data before, to continue it
+     * @return The same as CRC32::value() after updating with data
+     */
+    constexpr uint32_t crc32Constexpr(std::string_view data, uint32_t crc = 0) {
+        crc = ~crc;
+        for (size_t i = 0; i < data.size(); i++) {
+            crc ^= (uint8_t)data[i];
+            for (int j = 0; j < 8; j++) {
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+    /**
+     * Compare a digest with a hexadecimal string (lowercase or uppercase), usable in static_assert
+     */
+    template<size_t N>
+    constexpr bool hexEquals(const std::array<uint8_t, N>& digest, std::string_view hex) {
+        if (hex.size() != N * 2) return false;
+        for (size_t i = 0; i < N * 2; i++) {
+            char c = hex[i];
+            int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (v != ((i % 2) ? digest[i / 2] & 0x0f : digest[i / 2] >> 4)) return false;
+        }
+        return true;
+    }
+#endif
+    namespace internal {
+        /**
+         * Hash multiple messages with SHA-256 (or SHA-224) using the multi-buffer engine
+         */
+        void sha256Batch(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, bool sha224);
+        /**
+         * Hash multiple messages with a SHA-3 (or SHAKE) sponge, 4 messages at a time with AVX2 when available
+         * @param rate Rate of the sponge in bytes
+         * @param digestLength Length of each digest
+         * @param xof Whether the messages are padded for SHAKE instead of SHA-3
+         */
+        void sha3Batch(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, size_t rate, size_t digestLength, bool xof);
+        template<class H>
+        struct BatchHasher {
+            template<typename ... Args>
+            static void hash(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, Args... args) {
+                H h(args...);
+                size_t len = h.digestLength();
+                for (size_t i = 0; i < count; i++) {
+                    h.reset();
+                    h.update(data[i], lens[i])->finish(out + i * len, len);
+                }
+            }
+        };
+        template<>
+        struct BatchHasher<SHA256> {
+            static void hash(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out) {
+                sha256Batch(data, lens, count, out, false);
+            }
+        };
+        template<>
+        struct BatchHasher<SHA224> {
+            static void hash(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out) {
+                sha256Batch(data, lens, count, out, true);
+            }
+        };
+        template<class H>
+        struct SHA3BatchHasher {
+            template<typename ... Args>
+            static void hash(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, Args... args) {
+                H h(args...);
+                sha3Batch(data, lens, count, out, h.blockSize(), h.digestLength(), std::is_same<H, SHAKE128>::value || std::is_same<H, SHAKE256>::value);
+            }
+        };
+        template<> struct BatchHasher<SHA3_224>: SHA3BatchHasher<SHA3_224> {};
+        template<> struct BatchHasher<SHA3_256>: SHA3BatchHasher<SHA3_256> {};
+        template<> struct BatchHasher<SHA3_384>: SHA3BatchHasher<SHA3_384> {};
+        template<> struct BatchHasher<SHA3_512>: SHA3BatchHasher<SHA3_512> {};
+        template<> struct BatchHasher<SHAKE128>: SHA3BatchHasher<SHAKE128> {};
+        template<> struct BatchHasher<SHAKE256>: SHA3BatchHasher<SHAKE256> {};
+    }
+    /**
+     * Hash multiple independent messages at once.
+     * SHA256 and SHA224 interleave the messages across SIMD lanes (8 with AVX2, 16 with AVX-512) when available,
+     * the SHA-3 family runs 4 Keccak states at once with AVX2, other hashes are computed one after another.
+     * @param data Messages
+     * @param lens Lengths of the messages
+     * @param count Count of the messages
+     * @param out Buffer to store the results, at least count * digestLength() bytes
+     */
+    template<class H, typename ... Args>
+    void hashBatch(const uint8_t* const* data, const size_t* lens, size_t count, uint8_t* out, Args... args) {
+        internal::BatchHasher<H>::hash(data, lens, count, out, args...);
+    }
+    template<class H, typename ... Args>
+    std::vector<std::vector<uint8_t>> hashBatch(const std::vector<std::vector<uint8_t>>& data, Args... args) {
+        std::vector<const uint8_t*> ptrs(data.size());
+        std::vector<size_t> lens(data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            ptrs[i] = data[i].data();
+            lens[i] = data[i].size();
+        }
+        size_t len = H(args...).digestLength();
+        std::vector<uint8_t> out(data.size() * len);
+        hashBatch<H>(ptrs.data(), lens.data(), data.size(), out.data(), args...);
+        std::vector<std::vector<uint8_t>> re(data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            re[i].assign(out.begin() + i * len, out.begin() + (i + 1) * len);
+        }
+        return re;
+    }
+    template<class H, typename ... Args>
+    std::vector<std::vector<uint8_t>> hashBatch(const std::vector<std::string>& data, Args... args) {
+        std::vector<const uint8_t*> ptrs(data.size());
+        std::vector<size_t> lens(data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            ptrs[i] = (const uint8_t*)data[i].c_str();
+            lens[i] = data[i].size();
+        }
+        size_t len = H(args...).digestLength();
+        std::vector<uint8_t> out(data.size() * len);
+        hashBatch<H>(ptrs.data(), lens.data(), data.size(), out.data(), args...);
+        std::vector<std::vector<uint8_t>> re(data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+            re[i].assign(out.begin() + i * len, out.begin() + (i + 1) * len);
+        }
+        return re;
+    }
     template<class H, typename ... Args>
     std::string hashHex(const uint8_t* data, size_t len, Args... args) {
         H h(args...);
         h.update(data, len);
         return h.hexDigest();
     }
+    /**
+     * Hash a file, reading it on a separate thread. See Hash::updateFilePipelined
+     * @param filePath File path
+     * @param bufferSize Size of each buffer
+     * @param queueDepth Count of buffers which can be filled ahead of the hasher
+     * @return Digest, empty if the file can not be read
+     */
+    template<class H, typename ... Args>
+    std::vector<uint8_t> hashFilePipelined(const std::string& filePath, size_t bufferSize, size_t queueDepth, Args... args) {
+        H h(args...);
+        if (!h.updateFilePipelined(filePath, bufferSize, queueDepth)) {
+            return {};
+        }
+        return h.digest();
+    }
     template<class H, typename ... Args>
     std::string hashHex(const std::string& data, Args... args) {
         H h(args...);
@@ -304,36 +1211,333 @@ namespace hash_lib {
         h.update(data);
         return h.hexDigest();
     }
+    /**
+     * Hash a file read in large chunks, it is never memory mapped. See Hash::updateFile
+     * @param filePath File path
+     * @return Digest, empty if the file can not be read
+     */
     template<class H, typename ... Args>
     std::vector<uint8_t> hashFile(const std::string& filePath, Args... args) {
-        FILE* f = fileop::fopen(filePath.c_str(), "rb");
-        if (!f) {
-            return {};
-        }
         H h(args...);
-        h.update(f);
-        if (ferror(f)) {
-            fileop::fclose(f);
+        if (!h.updateFile(filePath)) {
             return {};
         }
-        fileop::fclose(f);
         return h.digest();
     }
     template<class H, typename ... Args>
     std::string hashHexFile(const std::string& filePath, Args... args) {
-        FILE* f = fileop::fopen(filePath.c_str(), "rb");
-        if (!f) {
+        H h(args...);
+        if (!h.updateFile(filePath)) {
             return "";
         }
+        return h.hexDigest();
+    }
+    /**
+     * Hash a regular file in place through memory maps, see Hash::updateFile with mapped.
+     * Truncating the file or an I/O error while it is hashed raises SIGBUS.
+     * @param filePath File path
+     * @return Digest, empty if the file can not be read
+     */
+    template<class H, typename ... Args>
+    std::vector<uint8_t> hashFileMapped(const std::string& filePath, Args... args) {
+        H h(args...);
+        if (!h.updateFile(filePath, true)) {
+            return {};
+        }
+        return h.digest();
+    }
+    template<class H, typename ... Args>
+    std::string hashHexFileMapped(const std::string& filePath, Args... args) {
         H h(args...);
-        h.update(f);
-        if (ferror(f)) {
-            fileop::fclose(f);
+        if (!h.updateFile(filePath, true)) {
             return "";
         }
-        fileop::fclose(f);
         return h.hexDigest();
     }
+    /**
+     * Result of hashFiles for one file
+     */
+    struct FileHashResult {
+        std::string path;
+        // Size of the file when the work was scheduled, 0 if it could not be read
+        uint64_t size = 0;
+        // Digest, empty on error
+        std::vector<uint8_t> digest;
+        // errno of the failure (see err::get_errno_message), 0 on success
+        int error = 0;
+        bool ok() const {
+            return error == 0;
+        }
+    };
+    namespace internal {
+        /**
+         * Scheduler of hashFiles: the largest files start first, and the total size of the files being hashed
+         * stays below ioBudget (a file larger than the budget is hashed alone)
+         * @param hashOne Hash one file into the digest, returns false and sets errno on error
+         */
+        std::vector<FileHashResult> hashFiles(const std::vector<std::string>& paths, unsigned int threads, uint64_t ioBudget, const std::function<bool(const std::string&, std::vector<uint8_t>&)>& hashOne);
+    }
+    /**
+     * Hash many files concurrently with Hash::updateFile
+     * @param paths Paths of the files
+     * @param threads Count of worker threads, 0 means all cores
+     * @param ioBudget Maximum total size of the files being hashed at the same time
+     * @return Result of each file, in the order of paths
+     */
+    template<class H, typename ... Args>
+    std::vector<FileHashResult> hashFiles(const std::vector<std::string>& paths, unsigned int threads = 0, uint64_t ioBudget = (uint64_t)256 << 20, Args... args) {
+        return internal::hashFiles(paths, threads, ioBudget, [&](const std::string& path, std::vector<uint8_t>& digest) {
+            H h(args...);
+            if (!h.updateFile(path)) return false;
+            digest = h.digest();
+            return true;
+        });
+    }
+    /**
+     * A chunk found by FastCDC
+     */
+    struct CDCChunk {
+        // Offset from the start of the data
+        uint64_t offset;
+        size_t length;
+        // Digest of the content of the chunk
+        std::vector<uint8_t> digest;
+    };
+    /**
+     * FastCDC content-defined chunking: gear rolling hash, normalized chunking and two bytes per step.
+     * Boundaries only depend on the bytes before them, so an insertion only changes the chunks around it.
+     */
+    class FastCDC {
+    public:
+        /**
+         * @param minSize Minimum size of a chunk, its bytes are skipped without hashing
+         * @param avgSize Expected size of a chunk, rounded down to a power of 2
+         * @param maxSize Maximum size of a chunk
+         * @param normalization Normalization level, higher levels give sizes closer to avgSize
+         */
+        explicit FastCDC(size_t minSize = 2048, size_t avgSize = 8192, size_t maxSize = 65536, int normalization = 1);
+        /**
+         * Find the end of the next chunk
+         * @param data Data from the start of the chunk
+         * @param len Length of the data, the chunk ends at len if there is no boundary before it
+         * @return Length of the chunk
+         */
+        size_t cut(const uint8_t* data, size_t len) const;
+        size_t minSize() const {
+            return _minSize;
+        }
+        size_t avgSize() const {
+            return _avgSize;
+        }
+        size_t maxSize() const {
+            return _maxSize;
+        }
+        /**
+         * Split a buffer into chunks and hash each chunk with H
+         */
+        template<class H, typename ... Args>
+        std::vector<CDCChunk> chunk(const uint8_t* data, size_t len, Args... args) const {
+            std::vector<CDCChunk> chunks;
+            H h(args...);
+            uint64_t offset = 0;
+            while (offset < len) {
+                size_t n = cut(data + offset, len - offset);
+                h.reset();
+                h.update(data + offset, n);
+                chunks.push_back({ offset, n, h.digest() });
+                offset += n;
+            }
+            return chunks;
+        }
+        template<class H, typename ... Args>
+        std::vector<CDCChunk> chunk(const std::vector<uint8_t>& data, Args... args) const {
+            return chunk<H>(data.data(), data.size(), args...);
+        }
+        /**
+         * Split a stream into chunks and hash each chunk with H, reading from the current position
+         * @param stream Stream to read
+         * @param callback Called for every chunk in order
+         * @return false if the stream can not be read
+         */
+        template<class H, typename ... Args>
+        bool forEachChunk(ReadStream& stream, const std::function<void(const CDCChunk&)>& callback, Args... args) const {
+            std::vector<uint8_t> buf(_maxSize * 4 > ((size_t)1 << 20) ? _maxSize * 4 : (size_t)1 << 20);
+            size_t begin = 0, end = 0;
+            uint64_t offset = 0;
+            bool eof = false;
+            H h(args...);
+            while (true) {
+                if (!eof && end - begin < _maxSize) {
+                    memmove(buf.data(), buf.data() + begin, end - begin);
+                    end -= begin;
+                    begin = 0;
+                    while (end < buf.size()) {
+                        size_t r = stream.read(buf.data() + end, buf.size() - end);
+                        if (r == 0) {
+                            eof = true;
+                            break;
+                        }
+                        end += r;
+                    }
+                    if (stream.error()) return false;
+                }
+                if (begin == end) break;
+                size_t n = cut(buf.data() + begin, end - begin);
+                h.reset();
+                h.update(buf.data() + begin, n);
+                callback({ offset, n, h.digest() });
+                begin += n;
+                offset += n;
+            }
+            return true;
+        }
+        template<class H, typename ... Args>
+        bool chunk(ReadStream& stream, std::vector<CDCChunk>& chunks, Args... args) const {
+            chunks.clear();
+            return forEachChunk<H>(stream, [&chunks](const CDCChunk& c) {
+                chunks.push_back(c);
+            }, args...);
+        }
+    private:
+        size_t _minSize;
+        size_t _avgSize;
+        size_t _maxSize;
+        uint64_t _maskS;
+        uint64_t _maskL;
+    };
+    /**
+     * Result of MerkleHasher
+     */
+    struct MerkleTree {
+        // Size of every leaf except the last one
+        size_t leafSize = 0;
+        // Total length of the hashed data
+        uint64_t length = 0;
+        // Digest of each leaf
+        std::vector<std::vector<uint8_t>> leaves;
+        // Root digest, the digest of empty data when there are no leaves
+        std::vector<uint8_t> root;
+    };
+    /**
+     * Merkle tree over fixed-size leaves, with the domain separation of RFC 6962:
+     * a leaf is H(0x00 || data), a node is H(0x01 || left || right), a node without sibling moves up unchanged.
+     * Leaves can be verified and repaired one by one, rootOf() rebuilds the root from a list of leaves.
+     */
+    template<class H>
+    class MerkleHasher {
+    public:
+        /**
+         * @param leafSize Size of each leaf
+         * @param threads Count of threads hashing leaves, 0 means all cores
+         */
+        explicit MerkleHasher(size_t leafSize = 1 << 20, unsigned int threads = 0): _leafSize(leafSize ? leafSize : 1), _threads(threads) {}
+        /**
+         * Hash the whole content of a stream.
+         * Seekable streams are read with read_at from multiple threads and keep their position. This is safe for
+         * FileReadStream, MmapReadStream, MemReadStream, MemViewReadStream and ReadStreamRegion over them, use a single thread for other streams.
+         * Streams which are not seekable are read sequentially from the current position.
+         * @param stream Stream to read
+         * @param tree Result
+         * @return false if the stream can not be read
+         */
+        bool hash(ReadStream& stream, MerkleTree& tree) const {
+            tree.leafSize = _leafSize;
+            tree.length = 0;
+            tree.leaves.clear();
+            if (!stream.seekable()) {
+                std::vector<uint8_t> buf(_leafSize);
+                size_t n;
+                while ((n = readFull(stream, buf.data())) > 0) {
+                    tree.leaves.push_back(leafHash(buf.data(), n));
+                    tree.length += n;
+                    if (n < _leafSize) break;
+                }
+                if (stream.error()) return false;
+                tree.root = rootOf(tree.leaves);
+                return true;
+            }
+            int64_t pos = stream.tell();
+            if (pos < 0 || !stream.seek(0, SEEK_END)) return false;
+            int64_t length = stream.tell();
+            if (!stream.seek(pos, SEEK_SET) || length < 0) return false;
+            tree.length = (uint64_t)length;
+            size_t count = (size_t)((tree.length + _leafSize - 1) / _leafSize);
+            tree.leaves.resize(count);
+            std::atomic<bool> failed(false);
+            internal::parallelFor(count, _threads, [&](size_t i) {
+                if (failed.load(std::memory_order_relaxed)) return;
+                uint64_t offset = (uint64_t)i * _leafSize;
+                size_t len = tree.length - offset < _leafSize ? (size_t)(tree.length - offset) : _leafSize;
+                std::vector<uint8_t> buf(len);
+                size_t readed = 0;
+                while (readed < len) {
+                    size_t r = stream.read_at(buf.data() + readed, len - readed, (int64_t)(offset + readed));
+                    if (r == 0) break;
+                    readed += r;
+                }
+                if (readed != len) {
+                    failed = true;
+                    return;
+                }
+                tree.leaves[i] = leafHash(buf.data(), len);
+            });
+            if (failed || stream.error()) return false;
+            tree.root = rootOf(tree.leaves);
+            return true;
+        }
+        /**
+         * @return H(0x00 || data)
+         */
+        static std::vector<uint8_t> leafHash(const uint8_t* data, size_t len) {
+            uint8_t prefix = 0;
+            H h;
+            h.update(&prefix, 1)->update(data, len);
+            return h.digest();
+        }
+        /**
+         * @return H(0x01 || left || right)
+         */
+        static std::vector<uint8_t> nodeHash(const std::vector<uint8_t>& left, const std::vector<uint8_t>& right) {
+            uint8_t prefix = 1;
+            H h;
+            h.update(&prefix, 1)->update(left)->update(right);
+            return h.digest();
+        }
+        /**
+         * Compute the root from the digests of the leaves
+         */
+        static std::vector<uint8_t> rootOf(const std::vector<std::vector<uint8_t>>& leaves) {
+            if (leaves.empty()) {
+                H h;
+                return h.digest();
+            }
+            std::vector<std::vector<uint8_t>> level = leaves;
+            while (level.size() > 1) {
+                size_t n = level.size() / 2;
+                for (size_t i = 0; i < n; i++) {
+                    level[i] = nodeHash(level[i * 2], level[i * 2 + 1]);
+                }
+                if (level.size() & 1) {
+                    level[n] = std::move(level.back());
+                    n++;
+                }
+                level.resize(n);
+            }
+            return level[0];
+        }
+    private:
+        size_t readFull(ReadStream& stream, uint8_t* buf) const {
+            size_t readed = 0;
+            while (readed < _leafSize) {
+                size_t r = stream.read(buf + readed, _leafSize - readed);
+                if (r == 0) break;
+                readed += r;
+            }
+            return readed;
+        }
+        size_t _leafSize;
+        unsigned int _threads;
+    };
 }
 #endif
 #endif
@@ -0,0 +1,230 @@
+#include "hash_lib_internal.h"
+
+using namespace hash_lib::internal;
+
+#if HASH_LIB_ARM_CRYPTO
+#include <arm_neon.h>
+
+// Compute W[4g+16..4g+19] in place of W[4g..4g+3].
+#define SHA256_ARM_SCHEDULE(W0, W1, W2, W3) \
+        W0 = vsha256su1q_u32(vsha256su0q_u32(W0, W1), W2, W3);
+
+#define SHA256_ARM_ROUND4(g, W) \
+        tmp = vaddq_u32(W, vld1q_u32(&SHA256_K[(g) * 4])); \
+        abcd = state0; \
+        state0 = vsha256hq_u32(state0, state1, tmp); \
+        state1 = vsha256h2q_u32(state1, abcd, tmp);
+
+HASH_LIB_TARGET("arch=armv8-a+crypto")
+void hash_lib::internal::sha256BlocksArm(uint32_t state[8], const uint8_t* m, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    uint32x4_t msg0, msg1, msg2, msg3, tmp, abcd;
+    while (blocks--) {
+        uint32x4_t abcdSave = state0;
+        uint32x4_t efghSave = state1;
+        msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 0)));
+        msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 16)));
+        msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 32)));
+        msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 48)));
+        SHA256_ARM_ROUND4(0, msg0);
+        SHA256_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA256_ARM_ROUND4(1, msg1);
+        SHA256_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA256_ARM_ROUND4(2, msg2);
+        SHA256_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA256_ARM_ROUND4(3, msg3);
+        SHA256_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA256_ARM_ROUND4(4, msg0);
+        SHA256_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA256_ARM_ROUND4(5, msg1);
+        SHA256_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA256_ARM_ROUND4(6, msg2);
+        SHA256_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA256_ARM_ROUND4(7, msg3);
+        SHA256_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA256_ARM_ROUND4(8, msg0);
+        SHA256_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA256_ARM_ROUND4(9, msg1);
+        SHA256_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA256_ARM_ROUND4(10, msg2);
+        SHA256_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA256_ARM_ROUND4(11, msg3);
+        SHA256_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA256_ARM_ROUND4(12, msg0);
+        SHA256_ARM_ROUND4(13, msg1);
+        SHA256_ARM_ROUND4(14, msg2);
+        SHA256_ARM_ROUND4(15, msg3);
+        state0 = vaddq_u32(state0, abcdSave);
+        state1 = vaddq_u32(state1, efghSave);
+        m += 64;
+    }
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+// Compute W[4g+16..4g+19] in place of W[4g..4g+3].
+#define SHA1_ARM_SCHEDULE(W0, W1, W2, W3) \
+        W0 = vsha1su1q_u32(vsha1su0q_u32(W0, W1, W2), W3);
+
+#define SHA1_ARM_ROUND4(op, W, K) \
+        tmp = vaddq_u32(W, K); \
+        e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+        abcd = op(abcd, e0, tmp); \
+        e0 = e1;
+
+HASH_LIB_TARGET("arch=armv8-a+crypto")
+void hash_lib::internal::sha1BlocksArm(uint32_t state[5], const uint8_t* m, size_t blocks) {
+    const uint32x4_t k0 = vdupq_n_u32(0x5A827999);
+    const uint32x4_t k1 = vdupq_n_u32(0x6ED9EBA1);
+    const uint32x4_t k2 = vdupq_n_u32(0x8F1BBCDC);
+    const uint32x4_t k3 = vdupq_n_u32(0xCA62C1D6);
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32_t e0 = state[4], e1;
+    uint32x4_t msg0, msg1, msg2, msg3, tmp;
+    while (blocks--) {
+        uint32x4_t abcdSave = abcd;
+        uint32_t eSave = e0;
+        msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 0)));
+        msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 16)));
+        msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 32)));
+        msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(m + 48)));
+        SHA1_ARM_ROUND4(vsha1cq_u32, msg0, k0);
+        SHA1_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA1_ARM_ROUND4(vsha1cq_u32, msg1, k0);
+        SHA1_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA1_ARM_ROUND4(vsha1cq_u32, msg2, k0);
+        SHA1_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA1_ARM_ROUND4(vsha1cq_u32, msg3, k0);
+        SHA1_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA1_ARM_ROUND4(vsha1cq_u32, msg0, k0);
+        SHA1_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg1, k1);
+        SHA1_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg2, k1);
+        SHA1_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg3, k1);
+        SHA1_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg0, k1);
+        SHA1_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg1, k1);
+        SHA1_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA1_ARM_ROUND4(vsha1mq_u32, msg2, k2);
+        SHA1_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA1_ARM_ROUND4(vsha1mq_u32, msg3, k2);
+        SHA1_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA1_ARM_ROUND4(vsha1mq_u32, msg0, k2);
+        SHA1_ARM_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHA1_ARM_ROUND4(vsha1mq_u32, msg1, k2);
+        SHA1_ARM_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHA1_ARM_ROUND4(vsha1mq_u32, msg2, k2);
+        SHA1_ARM_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg3, k3);
+        SHA1_ARM_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg0, k3);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg1, k3);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg2, k3);
+        SHA1_ARM_ROUND4(vsha1pq_u32, msg3, k3);
+        abcd = vaddq_u32(abcd, abcdSave);
+        e0 += eSave;
+        m += 64;
+    }
+    vst1q_u32(&state[0], abcd);
+    state[4] = e0;
+}
+#endif
+
+#if HASH_LIB_ARM_CRC32
+#include <arm_acle.h>
+#include <string.h>
+
+HASH_LIB_TARGET("arch=armv8-a+crc")
+uint32_t hash_lib::internal::crc32Arm(uint32_t crc, const uint8_t* m, size_t len) {
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, m, 8);
+        crc = __crc32d(crc, w);
+        m += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32b(crc, *m++);
+    }
+    return crc;
+}
+
+static inline uint32_t crc32cShift(const uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+// 3 independent streams hide the latency of crc32c, see crc32cSse42.
+HASH_LIB_TARGET("arch=armv8-a+crc")
+uint32_t hash_lib::internal::crc32cArm(uint32_t crc, const uint8_t* m, size_t len) {
+    const CRC32CShiftTables& tables = crc32cShiftTables();
+    const size_t streams[2] = { CRC32C_LONG, CRC32C_SHORT };
+    for (int s = 0; s < 2; s++) {
+        size_t n = streams[s];
+        const uint32_t (*shift)[256] = s == 0 ? tables.longShift : tables.shortShift;
+        while (len >= n * 3) {
+            uint32_t crc1 = 0, crc2 = 0;
+            for (size_t i = 0; i < n; i += 8) {
+                uint64_t w0, w1, w2;
+                memcpy(&w0, m + i, 8);
+                memcpy(&w1, m + n + i, 8);
+                memcpy(&w2, m + n * 2 + i, 8);
+                crc = __crc32cd(crc, w0);
+                crc1 = __crc32cd(crc1, w1);
+                crc2 = __crc32cd(crc2, w2);
+            }
+            crc = crc32cShift(shift, crc) ^ crc1;
+            crc = crc32cShift(shift, crc) ^ crc2;
+            m += n * 3;
+            len -= n * 3;
+        }
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, m, 8);
+        crc = __crc32cd(crc, w);
+        m += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *m++);
+    }
+    return crc;
+}
+#endif
+
+#if HASH_LIB_ARM_NEON
+#include <arm_neon.h>
+
+#define XXH3_PRIME32_1 0x9E3779B1U
+
+void hash_lib::internal::xxh3AccumulateNeon(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes) {
+    uint64x2_t a[4];
+    for (int i = 0; i < 4; i++) a[i] = vld1q_u64(acc + 2 * i);
+    for (size_t s = 0; s < stripes; s++) {
+        const uint8_t* in = input + s * 64;
+        const uint8_t* key = secret + s * 8;
+        for (int i = 0; i < 4; i++) {
+            uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(in + 16 * i));
+            uint64x2_t dataKey = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(key + 16 * i)));
+            a[i] = vaddq_u64(a[i], vextq_u64(data, data, 1));
+            a[i] = vmlal_u32(a[i], vmovn_u64(dataKey), vshrn_n_u64(dataKey, 32));
+        }
+    }
+    for (int i = 0; i < 4; i++) vst1q_u64(acc + 2 * i, a[i]);
+}
+
+void hash_lib::internal::xxh3ScrambleNeon(uint64_t acc[8], const uint8_t* secret) {
+    const uint32x2_t prime = vdup_n_u32(XXH3_PRIME32_1);
+    for (int i = 0; i < 4; i++) {
+        uint64x2_t a = vld1q_u64(acc + 2 * i);
+        a = veorq_u64(a, vshrq_n_u64(a, 47));
+        a = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+        uint64x2_t productHi = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+        vst1q_u64(acc + 2 * i, vmlal_u32(productHi, vmovn_u64(a), prime));
+    }
+}
+#endif
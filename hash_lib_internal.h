@@ -0,0 +1,168 @@
+#ifndef _UTIL_HASH_LIB_INTERNAL_H
+#define _UTIL_HASH_LIB_INTERNAL_H
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HASH_LIB_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define HASH_LIB_TARGET(x)
+#else
+#define HASH_LIB_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#if defined(_MSC_VER) && !defined(__clang__)
+#define HASH_LIB_TARGET(x)
+#else
+#define HASH_LIB_TARGET(x) __attribute__((target(x)))
+#endif
+// ARMv8 crypto kernels enable the extension with HASH_LIB_TARGET and are picked at runtime.
+// Clang declares the intrinsics for such functions since version 16, older versions need the extension
+// enabled for the whole build (e.g. -march=armv8-a+crypto).
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2) || defined(_MSC_VER) || \
+    (defined(__clang__) && __clang_major__ >= 16) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6)
+#define HASH_LIB_ARM_CRYPTO 1
+#endif
+// Same for the CRC32 extension, Clang declares its intrinsics for such functions since version 17
+#if defined(__ARM_FEATURE_CRC32) || defined(_MSC_VER) || \
+    (defined(__clang__) && __clang_major__ >= 17) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6)
+#define HASH_LIB_ARM_CRC32 1
+#endif
+// Advanced SIMD is part of the AArch64 baseline
+#define HASH_LIB_ARM_NEON 1
+#endif
+
+namespace hash_lib {
+    namespace internal {
+        extern const uint32_t SHA256_K[64];
+        extern const uint64_t SHA512_K[80];
+        extern const uint32_t BLAKE3_IV[8];
+        extern const uint8_t BLAKE3_MSG_SCHEDULE[7][16];
+        extern const uint64_t KECCAK_RC[24];
+        extern const uint64_t CDC_GEAR[256];
+        /**
+         * Compress blocks into SHA-256 state
+         * @param state SHA-256 state (a, b, c, d, e, f, g, h)
+         * @param m Message blocks
+         * @param blocks Count of 64-byte blocks
+         */
+        typedef void (*SHA256BlocksFunc)(uint32_t state[8], const uint8_t* m, size_t blocks);
+        /**
+         * Compress blocks into SHA-1 state
+         * @param state SHA-1 state (a, b, c, d, e)
+         * @param m Message blocks
+         * @param blocks Count of 64-byte blocks
+         */
+        typedef void (*SHA1BlocksFunc)(uint32_t state[5], const uint8_t* m, size_t blocks);
+        /**
+         * Compress blocks of independent messages into interleaved SHA-256 states
+         * @param state Word i of lane j is stored at state[i * lanes + j]
+         * @param m Message of each lane, each one has at least blocks * 64 bytes
+         * @param blocks Count of 64-byte blocks
+         */
+        typedef void (*SHA256MultiBlocksFunc)(uint32_t* state, const uint8_t* const* m, size_t blocks);
+        /**
+         * Compute the SHA-512 message schedule of 4 consecutive blocks
+         * @param m 4 message blocks (512 bytes)
+         * @param wk W[i] + K[i] of block j is stored at wk[i * 4 + j]
+         */
+        typedef void (*SHA512ScheduleFunc)(const uint8_t* m, uint64_t wk[320]);
+        /**
+         * Compress whole BLAKE3 chunks (or parent nodes) of independent inputs, one input per SIMD lane
+         * @param inputs Input of each lane, each one has blocks * 64 bytes
+         * @param blocks Count of 64-byte blocks of each input
+         * @param key Key words (the IV when not keyed)
+         * @param counter Counter of the first input
+         * @param incrementCounter Whether lane j uses counter + j, otherwise all lanes use counter
+         * @param flags Flags of every block
+         * @param flagsStart Extra flags of the first block
+         * @param flagsEnd Extra flags of the last block
+         * @param out 32-byte chaining value of each lane
+         */
+        typedef void (*BLAKE3HashManyFunc)(const uint8_t* const* inputs, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out);
+        /**
+         * Update a CRC register (not inverted) with data
+         * @param crc CRC register
+         * @param m Data
+         * @param len Length of the data
+         * @return The new CRC register
+         */
+        typedef uint32_t (*CRCFunc)(uint32_t crc, const uint8_t* m, size_t len);
+        /**
+         * Tables to advance a CRC-32C register over CRC32C_LONG (longShift) or CRC32C_SHORT (shortShift) zero bytes,
+         * the register is the xor of table[k][byte k of the register]
+         */
+        struct CRC32CShiftTables {
+            uint32_t longShift[4][256];
+            uint32_t shortShift[4][256];
+        };
+        // Lengths of the 3 interleaved streams of crc32cSse42/crc32cArm
+        const size_t CRC32C_LONG = 8192;
+        const size_t CRC32C_SHORT = 256;
+        const CRC32CShiftTables& crc32cShiftTables();
+        /**
+         * Absorb blocks of 4 independent messages into 4 interleaved Keccak-f[1600] states
+         * @param state Lane i of state j is stored at state[i * 4 + j]
+         * @param m Message of each state, each one has blocks * rate bytes
+         * @param blocks Count of blocks
+         * @param rate Rate of the sponge in bytes, a multiple of 8
+         */
+        typedef void (*KeccakX4AbsorbFunc)(uint64_t* state, const uint8_t* const* m, size_t blocks, size_t rate);
+        /**
+         * Accumulate 64-byte stripes into XXH3 accumulators
+         * @param acc XXH3 accumulators
+         * @param input Stripes
+         * @param secret Secret of the first stripe, it advances by 8 bytes per stripe
+         * @param stripes Count of stripes
+         */
+        typedef void (*XXH3AccumulateFunc)(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes);
+        /**
+         * Scramble XXH3 accumulators at the end of a block
+         * @param acc XXH3 accumulators
+         * @param secret 64 bytes of the secret
+         */
+        typedef void (*XXH3ScrambleFunc)(uint64_t acc[8], const uint8_t* secret);
+        // Portable implementations, also used by hardware kernels for short inputs
+        uint32_t crc32Software(uint32_t crc, const uint8_t* m, size_t len);
+        uint32_t crc32cSoftware(uint32_t crc, const uint8_t* m, size_t len);
+        /**
+         * Whether hardware implementations may be used, see hash_lib::setHardwareAcceleration
+         */
+        bool useHardware();
+#if HASH_LIB_X86
+        void sha256BlocksShaNi(uint32_t state[8], const uint8_t* m, size_t blocks);
+        void sha1BlocksShaNi(uint32_t state[5], const uint8_t* m, size_t blocks);
+        // 8 lanes
+        void sha256MultiBlocksAvx2(uint32_t* state, const uint8_t* const* m, size_t blocks);
+        // 16 lanes
+        void sha256MultiBlocksAvx512(uint32_t* state, const uint8_t* const* m, size_t blocks);
+        void sha512ScheduleAvx2(const uint8_t* m, uint64_t wk[320]);
+        uint32_t crc32Pclmul(uint32_t crc, const uint8_t* m, size_t len);
+        uint32_t crc32cSse42(uint32_t crc, const uint8_t* m, size_t len);
+        // 8 lanes
+        void blake3HashManyAvx2(const uint8_t* const* inputs, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out);
+        // 16 lanes
+        void blake3HashManyAvx512(const uint8_t* const* inputs, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out);
+        void keccakX4AbsorbAvx2(uint64_t* state, const uint8_t* const* m, size_t blocks, size_t rate);
+        void xxh3AccumulateSse2(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes);
+        void xxh3ScrambleSse2(uint64_t acc[8], const uint8_t* secret);
+        void xxh3AccumulateAvx2(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes);
+        void xxh3ScrambleAvx2(uint64_t acc[8], const uint8_t* secret);
+#endif
+#if HASH_LIB_ARM_CRYPTO
+        void sha256BlocksArm(uint32_t state[8], const uint8_t* m, size_t blocks);
+        void sha1BlocksArm(uint32_t state[5], const uint8_t* m, size_t blocks);
+#endif
+#if HASH_LIB_ARM_CRC32
+        uint32_t crc32Arm(uint32_t crc, const uint8_t* m, size_t len);
+        uint32_t crc32cArm(uint32_t crc, const uint8_t* m, size_t len);
+#endif
+#if HASH_LIB_ARM_NEON
+        void xxh3AccumulateNeon(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes);
+        void xxh3ScrambleNeon(uint64_t acc[8], const uint8_t* secret);
+#endif
+    }
+}
+#endif
@@ -0,0 +1,778 @@
+#include "hash_lib_internal.h"
+
+#if HASH_LIB_X86
+#include <immintrin.h>
+#include <string.h>
+
+using namespace hash_lib::internal;
+
+#define SHA256_NI_ROUND4(g, W) \
+        msg = _mm_add_epi32(W, _mm_loadu_si128((const __m128i*)&SHA256_K[(g) * 4])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+        msg = _mm_shuffle_epi32(msg, 0x0E); \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+#define SHA256_NI_MSG1(W, PREV) \
+        PREV = _mm_sha256msg1_epu32(PREV, W);
+
+#define SHA256_NI_MSG2(W, PREV, NEXT) \
+        tmp = _mm_alignr_epi8(W, PREV, 4); \
+        NEXT = _mm_add_epi32(NEXT, tmp); \
+        NEXT = _mm_sha256msg2_epu32(NEXT, W);
+
+HASH_LIB_TARGET("sha,ssse3,sse4.1")
+void hash_lib::internal::sha256BlocksShaNi(uint32_t state[8], const uint8_t* m, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+    // The SHA instructions work on (a, b, e, f) and (c, d, g, h).
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    __m128i msg, msg0, msg1, msg2, msg3;
+    while (blocks--) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 0)), mask);
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 16)), mask);
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 32)), mask);
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 48)), mask);
+        SHA256_NI_ROUND4(0, msg0);
+        SHA256_NI_ROUND4(1, msg1);
+        SHA256_NI_MSG1(msg1, msg0);
+        SHA256_NI_ROUND4(2, msg2);
+        SHA256_NI_MSG1(msg2, msg1);
+        SHA256_NI_ROUND4(3, msg3);
+        SHA256_NI_MSG2(msg3, msg2, msg0);
+        SHA256_NI_MSG1(msg3, msg2);
+        SHA256_NI_ROUND4(4, msg0);
+        SHA256_NI_MSG2(msg0, msg3, msg1);
+        SHA256_NI_MSG1(msg0, msg3);
+        SHA256_NI_ROUND4(5, msg1);
+        SHA256_NI_MSG2(msg1, msg0, msg2);
+        SHA256_NI_MSG1(msg1, msg0);
+        SHA256_NI_ROUND4(6, msg2);
+        SHA256_NI_MSG2(msg2, msg1, msg3);
+        SHA256_NI_MSG1(msg2, msg1);
+        SHA256_NI_ROUND4(7, msg3);
+        SHA256_NI_MSG2(msg3, msg2, msg0);
+        SHA256_NI_MSG1(msg3, msg2);
+        SHA256_NI_ROUND4(8, msg0);
+        SHA256_NI_MSG2(msg0, msg3, msg1);
+        SHA256_NI_MSG1(msg0, msg3);
+        SHA256_NI_ROUND4(9, msg1);
+        SHA256_NI_MSG2(msg1, msg0, msg2);
+        SHA256_NI_MSG1(msg1, msg0);
+        SHA256_NI_ROUND4(10, msg2);
+        SHA256_NI_MSG2(msg2, msg1, msg3);
+        SHA256_NI_MSG1(msg2, msg1);
+        SHA256_NI_ROUND4(11, msg3);
+        SHA256_NI_MSG2(msg3, msg2, msg0);
+        SHA256_NI_MSG1(msg3, msg2);
+        SHA256_NI_ROUND4(12, msg0);
+        SHA256_NI_MSG2(msg0, msg3, msg1);
+        SHA256_NI_MSG1(msg0, msg3);
+        SHA256_NI_ROUND4(13, msg1);
+        SHA256_NI_MSG2(msg1, msg0, msg2);
+        SHA256_NI_ROUND4(14, msg2);
+        SHA256_NI_MSG2(msg2, msg1, msg3);
+        SHA256_NI_ROUND4(15, msg3);
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+        m += 64;
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+#define SHA1_NI_ROUND4(E_IN, E_OUT, W, f) \
+        E_IN = _mm_sha1nexte_epu32(E_IN, W); \
+        E_OUT = abcd; \
+        abcd = _mm_sha1rnds4_epu32(abcd, E_IN, f);
+
+#define SHA1_NI_MSG1(W, PREV) \
+        PREV = _mm_sha1msg1_epu32(PREV, W);
+
+#define SHA1_NI_XOR(W, X) \
+        X = _mm_xor_si128(X, W);
+
+#define SHA1_NI_MSG2(W, NEXT) \
+        NEXT = _mm_sha1msg2_epu32(NEXT, W);
+
+HASH_LIB_TARGET("sha,ssse3,sse4.1")
+void hash_lib::internal::sha1BlocksShaNi(uint32_t state[5], const uint8_t* m, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+    __m128i e1, msg0, msg1, msg2, msg3;
+    while (blocks--) {
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 0)), mask);
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 16)), mask);
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 32)), mask);
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(m + 48)), mask);
+        e0 = _mm_add_epi32(e0, msg0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        SHA1_NI_ROUND4(e1, e0, msg1, 0);
+        SHA1_NI_MSG1(msg1, msg0);
+        SHA1_NI_ROUND4(e0, e1, msg2, 0);
+        SHA1_NI_MSG1(msg2, msg1);
+        SHA1_NI_XOR(msg2, msg0);
+        SHA1_NI_ROUND4(e1, e0, msg3, 0);
+        SHA1_NI_MSG2(msg3, msg0);
+        SHA1_NI_MSG1(msg3, msg2);
+        SHA1_NI_XOR(msg3, msg1);
+        SHA1_NI_ROUND4(e0, e1, msg0, 0);
+        SHA1_NI_MSG2(msg0, msg1);
+        SHA1_NI_MSG1(msg0, msg3);
+        SHA1_NI_XOR(msg0, msg2);
+        SHA1_NI_ROUND4(e1, e0, msg1, 1);
+        SHA1_NI_MSG2(msg1, msg2);
+        SHA1_NI_MSG1(msg1, msg0);
+        SHA1_NI_XOR(msg1, msg3);
+        SHA1_NI_ROUND4(e0, e1, msg2, 1);
+        SHA1_NI_MSG2(msg2, msg3);
+        SHA1_NI_MSG1(msg2, msg1);
+        SHA1_NI_XOR(msg2, msg0);
+        SHA1_NI_ROUND4(e1, e0, msg3, 1);
+        SHA1_NI_MSG2(msg3, msg0);
+        SHA1_NI_MSG1(msg3, msg2);
+        SHA1_NI_XOR(msg3, msg1);
+        SHA1_NI_ROUND4(e0, e1, msg0, 1);
+        SHA1_NI_MSG2(msg0, msg1);
+        SHA1_NI_MSG1(msg0, msg3);
+        SHA1_NI_XOR(msg0, msg2);
+        SHA1_NI_ROUND4(e1, e0, msg1, 1);
+        SHA1_NI_MSG2(msg1, msg2);
+        SHA1_NI_MSG1(msg1, msg0);
+        SHA1_NI_XOR(msg1, msg3);
+        SHA1_NI_ROUND4(e0, e1, msg2, 2);
+        SHA1_NI_MSG2(msg2, msg3);
+        SHA1_NI_MSG1(msg2, msg1);
+        SHA1_NI_XOR(msg2, msg0);
+        SHA1_NI_ROUND4(e1, e0, msg3, 2);
+        SHA1_NI_MSG2(msg3, msg0);
+        SHA1_NI_MSG1(msg3, msg2);
+        SHA1_NI_XOR(msg3, msg1);
+        SHA1_NI_ROUND4(e0, e1, msg0, 2);
+        SHA1_NI_MSG2(msg0, msg1);
+        SHA1_NI_MSG1(msg0, msg3);
+        SHA1_NI_XOR(msg0, msg2);
+        SHA1_NI_ROUND4(e1, e0, msg1, 2);
+        SHA1_NI_MSG2(msg1, msg2);
+        SHA1_NI_MSG1(msg1, msg0);
+        SHA1_NI_XOR(msg1, msg3);
+        SHA1_NI_ROUND4(e0, e1, msg2, 2);
+        SHA1_NI_MSG2(msg2, msg3);
+        SHA1_NI_MSG1(msg2, msg1);
+        SHA1_NI_XOR(msg2, msg0);
+        SHA1_NI_ROUND4(e1, e0, msg3, 3);
+        SHA1_NI_MSG2(msg3, msg0);
+        SHA1_NI_MSG1(msg3, msg2);
+        SHA1_NI_XOR(msg3, msg1);
+        SHA1_NI_ROUND4(e0, e1, msg0, 3);
+        SHA1_NI_MSG2(msg0, msg1);
+        SHA1_NI_MSG1(msg0, msg3);
+        SHA1_NI_XOR(msg0, msg2);
+        SHA1_NI_ROUND4(e1, e0, msg1, 3);
+        SHA1_NI_MSG2(msg1, msg2);
+        SHA1_NI_XOR(msg1, msg3);
+        SHA1_NI_ROUND4(e0, e1, msg2, 3);
+        SHA1_NI_MSG2(msg2, msg3);
+        SHA1_NI_ROUND4(e1, e0, msg3, 3);
+        e0 = _mm_sha1nexte_epu32(e0, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+        m += 64;
+    }
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = _mm_extract_epi32(e0, 3);
+}
+
+// Load 8 words of 8 lanes and transpose them, so that out[t] holds word t of every lane.
+HASH_LIB_TARGET("avx2")
+static inline void loadTransposed8(const uint8_t* const* m, size_t offset, __m256i out[8]) {
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)(m[0] + offset));
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(m[1] + offset));
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(m[2] + offset));
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(m[3] + offset));
+    __m256i r4 = _mm256_loadu_si256((const __m256i*)(m[4] + offset));
+    __m256i r5 = _mm256_loadu_si256((const __m256i*)(m[5] + offset));
+    __m256i r6 = _mm256_loadu_si256((const __m256i*)(m[6] + offset));
+    __m256i r7 = _mm256_loadu_si256((const __m256i*)(m[7] + offset));
+    __m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi32(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi32(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+    __m256i t4 = _mm256_unpacklo_epi32(r4, r5);
+    __m256i t5 = _mm256_unpackhi_epi32(r4, r5);
+    __m256i t6 = _mm256_unpacklo_epi32(r6, r7);
+    __m256i t7 = _mm256_unpackhi_epi32(r6, r7);
+    r0 = _mm256_unpacklo_epi64(t0, t2);
+    r1 = _mm256_unpackhi_epi64(t0, t2);
+    r2 = _mm256_unpacklo_epi64(t1, t3);
+    r3 = _mm256_unpackhi_epi64(t1, t3);
+    r4 = _mm256_unpacklo_epi64(t4, t6);
+    r5 = _mm256_unpackhi_epi64(t4, t6);
+    r6 = _mm256_unpacklo_epi64(t5, t7);
+    r7 = _mm256_unpackhi_epi64(t5, t7);
+    out[0] = _mm256_permute2x128_si256(r0, r4, 0x20);
+    out[1] = _mm256_permute2x128_si256(r1, r5, 0x20);
+    out[2] = _mm256_permute2x128_si256(r2, r6, 0x20);
+    out[3] = _mm256_permute2x128_si256(r3, r7, 0x20);
+    out[4] = _mm256_permute2x128_si256(r0, r4, 0x31);
+    out[5] = _mm256_permute2x128_si256(r1, r5, 0x31);
+    out[6] = _mm256_permute2x128_si256(r2, r6, 0x31);
+    out[7] = _mm256_permute2x128_si256(r3, r7, 0x31);
+}
+
+// Same as loadTransposed8, but the words are big endian.
+HASH_LIB_TARGET("avx2")
+static inline void sha256LoadTransposed8(const uint8_t* const* m, size_t offset, __m256i out[8]) {
+    const __m256i bswap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    loadTransposed8(m, offset, out);
+    for (int i = 0; i < 8; i++) {
+        out[i] = _mm256_shuffle_epi8(out[i], bswap);
+    }
+}
+
+#define SHA256_AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::sha256MultiBlocksAvx2(uint32_t* state, const uint8_t* const* m, size_t blocks) {
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm256_loadu_si256((const __m256i*)(state + i * 8));
+    }
+    __m256i w[16];
+    for (size_t block = 0; block < blocks; block++) {
+        sha256LoadTransposed8(m, block * 64, w);
+        sha256LoadTransposed8(m, block * 64 + 32, w + 8);
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i++) {
+            __m256i wi;
+            if (i < 16) {
+                wi = w[i];
+            } else {
+                __m256i u = w[(i - 2) & 15];
+                __m256i t1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROTR(u, 17), SHA256_AVX2_ROTR(u, 19)), _mm256_srli_epi32(u, 10));
+                u = w[(i - 15) & 15];
+                __m256i t2 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROTR(u, 7), SHA256_AVX2_ROTR(u, 18)), _mm256_srli_epi32(u, 3));
+                wi = _mm256_add_epi32(_mm256_add_epi32(t1, w[(i - 7) & 15]), _mm256_add_epi32(t2, w[i & 15]));
+                w[i & 15] = wi;
+            }
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROTR(e, 6), SHA256_AVX2_ROTR(e, 11)), SHA256_AVX2_ROTR(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(wi, _mm256_set1_epi32(SHA256_K[i]))));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROTR(a, 2), SHA256_AVX2_ROTR(a, 13)), SHA256_AVX2_ROTR(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(_mm256_or_si256(a, b), c), _mm256_and_si256(a, b));
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+        }
+        s[0] = _mm256_add_epi32(s[0], a);
+        s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c);
+        s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e);
+        s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g);
+        s[7] = _mm256_add_epi32(s[7], h);
+    }
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)(state + i * 8), s[i]);
+    }
+}
+
+HASH_LIB_TARGET("avx2,avx512f")
+void hash_lib::internal::sha256MultiBlocksAvx512(uint32_t* state, const uint8_t* const* m, size_t blocks) {
+    __m512i s[8];
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm512_loadu_si512((const void*)(state + i * 16));
+    }
+    __m512i w[16];
+    __m256i lo[8], hi[8];
+    for (size_t block = 0; block < blocks; block++) {
+        for (int half = 0; half < 2; half++) {
+            sha256LoadTransposed8(m, block * 64 + half * 32, lo);
+            sha256LoadTransposed8(m + 8, block * 64 + half * 32, hi);
+            for (int i = 0; i < 8; i++) {
+                w[half * 8 + i] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[i]), hi[i], 1);
+            }
+        }
+        __m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i++) {
+            __m512i wi;
+            if (i < 16) {
+                wi = w[i];
+            } else {
+                __m512i u = w[(i - 2) & 15];
+                __m512i t1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(u, 17), _mm512_ror_epi32(u, 19), _mm512_srli_epi32(u, 10), 0x96);
+                u = w[(i - 15) & 15];
+                __m512i t2 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(u, 7), _mm512_ror_epi32(u, 18), _mm512_srli_epi32(u, 3), 0x96);
+                wi = _mm512_add_epi32(_mm512_add_epi32(t1, w[(i - 7) & 15]), _mm512_add_epi32(t2, w[i & 15]));
+                w[i & 15] = wi;
+            }
+            // 0x96: x ^ y ^ z, 0xca: x ? y : z, 0xe8: majority
+            __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25), 0x96);
+            __m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xca);
+            __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, s1), _mm512_add_epi32(ch, _mm512_add_epi32(wi, _mm512_set1_epi32(SHA256_K[i]))));
+            __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22), 0x96);
+            __m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xe8);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm512_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm512_add_epi32(t1, _mm512_add_epi32(s0, maj));
+        }
+        s[0] = _mm512_add_epi32(s[0], a);
+        s[1] = _mm512_add_epi32(s[1], b);
+        s[2] = _mm512_add_epi32(s[2], c);
+        s[3] = _mm512_add_epi32(s[3], d);
+        s[4] = _mm512_add_epi32(s[4], e);
+        s[5] = _mm512_add_epi32(s[5], f);
+        s[6] = _mm512_add_epi32(s[6], g);
+        s[7] = _mm512_add_epi32(s[7], h);
+    }
+    for (int i = 0; i < 8; i++) {
+        _mm512_storeu_si512((void*)(state + i * 16), s[i]);
+    }
+}
+
+#define SHA512_AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+
+// Every 64-bit lane works on its own block, so the 4 schedules have no dependencies on each other.
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::sha512ScheduleAvx2(const uint8_t* m, uint64_t wk[320]) {
+    const __m256i bswap = _mm256_set_epi64x(0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL);
+    __m256i w[80];
+    for (int i = 0; i < 16; i += 4) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(m + i * 8));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(m + 128 + i * 8));
+        __m256i r2 = _mm256_loadu_si256((const __m256i*)(m + 256 + i * 8));
+        __m256i r3 = _mm256_loadu_si256((const __m256i*)(m + 384 + i * 8));
+        __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+        __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+        __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+        __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+        w[i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x20), bswap);
+        w[i + 1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x20), bswap);
+        w[i + 2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x31), bswap);
+        w[i + 3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x31), bswap);
+    }
+    for (int i = 16; i < 80; i++) {
+        __m256i u = w[i - 2];
+        __m256i t1 = _mm256_xor_si256(_mm256_xor_si256(SHA512_AVX2_ROTR(u, 19), SHA512_AVX2_ROTR(u, 61)), _mm256_srli_epi64(u, 6));
+        u = w[i - 15];
+        __m256i t2 = _mm256_xor_si256(_mm256_xor_si256(SHA512_AVX2_ROTR(u, 1), SHA512_AVX2_ROTR(u, 8)), _mm256_srli_epi64(u, 7));
+        w[i] = _mm256_add_epi64(_mm256_add_epi64(t1, w[i - 7]), _mm256_add_epi64(t2, w[i - 16]));
+    }
+    for (int i = 0; i < 80; i++) {
+        __m256i k = _mm256_set1_epi64x((long long)SHA512_K[i]);
+        _mm256_storeu_si256((__m256i*)(wk + i * 4), _mm256_add_epi64(w[i], k));
+    }
+}
+// Word i of lane j is words[i * lanes + j], write it as word i of the chaining value of lane j (x86 is little endian).
+static inline void blake3StoreCvs(const uint32_t* words, size_t lanes, uint8_t* out) {
+    for (size_t j = 0; j < lanes; j++) {
+        for (int i = 0; i < 8; i++) {
+            memcpy(out + j * 32 + i * 4, words + i * lanes + j, 4);
+        }
+    }
+}
+
+#define BLAKE3_AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define BLAKE3_AVX2_G(a, b, c, d, x, y) \
+        v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x); \
+        v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot16); \
+        v[c] = _mm256_add_epi32(v[c], v[d]); \
+        v[b] = BLAKE3_AVX2_ROTR(_mm256_xor_si256(v[b], v[c]), 12); \
+        v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y); \
+        v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot8); \
+        v[c] = _mm256_add_epi32(v[c], v[d]); \
+        v[b] = BLAKE3_AVX2_ROTR(_mm256_xor_si256(v[b], v[c]), 7);
+
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::blake3HashManyAvx2(const uint8_t* const* inputs, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out) {
+    const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                          13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rot8 = _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+                                         12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+    uint32_t counterLo[8], counterHi[8];
+    for (int j = 0; j < 8; j++) {
+        uint64_t c = counter + (incrementCounter ? j : 0);
+        counterLo[j] = (uint32_t)c;
+        counterHi[j] = (uint32_t)(c >> 32);
+    }
+    __m256i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm256_set1_epi32(key[i]);
+    }
+    __m256i m[16], v[16];
+    uint8_t blockFlags = flags | flagsStart;
+    for (size_t block = 0; block < blocks; block++) {
+        if (block + 1 == blocks) blockFlags |= flagsEnd;
+        loadTransposed8(inputs, block * 64, m);
+        loadTransposed8(inputs, block * 64 + 32, m + 8);
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi32(BLAKE3_IV[i]);
+        v[12] = _mm256_loadu_si256((const __m256i*)counterLo);
+        v[13] = _mm256_loadu_si256((const __m256i*)counterHi);
+        v[14] = _mm256_set1_epi32(64);
+        v[15] = _mm256_set1_epi32(blockFlags);
+        for (int r = 0; r < 7; r++) {
+            const uint8_t* s = BLAKE3_MSG_SCHEDULE[r];
+            BLAKE3_AVX2_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+            BLAKE3_AVX2_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+            BLAKE3_AVX2_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+            BLAKE3_AVX2_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+            BLAKE3_AVX2_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+            BLAKE3_AVX2_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+            BLAKE3_AVX2_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+            BLAKE3_AVX2_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        blockFlags = flags;
+    }
+    uint32_t words[64];
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)(words + i * 8), h[i]);
+    }
+    blake3StoreCvs(words, 8, out);
+}
+
+#define BLAKE3_AVX512_G(a, b, c, d, x, y) \
+        v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), x); \
+        v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 16); \
+        v[c] = _mm512_add_epi32(v[c], v[d]); \
+        v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 12); \
+        v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), y); \
+        v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 8); \
+        v[c] = _mm512_add_epi32(v[c], v[d]); \
+        v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 7);
+
+HASH_LIB_TARGET("avx2,avx512f")
+void hash_lib::internal::blake3HashManyAvx512(const uint8_t* const* inputs, size_t blocks, const uint32_t key[8], uint64_t counter, bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t* out) {
+    uint32_t counterLo[16], counterHi[16];
+    for (int j = 0; j < 16; j++) {
+        uint64_t c = counter + (incrementCounter ? j : 0);
+        counterLo[j] = (uint32_t)c;
+        counterHi[j] = (uint32_t)(c >> 32);
+    }
+    __m512i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm512_set1_epi32(key[i]);
+    }
+    __m512i m[16], v[16];
+    __m256i lo[8], hi[8];
+    uint8_t blockFlags = flags | flagsStart;
+    for (size_t block = 0; block < blocks; block++) {
+        if (block + 1 == blocks) blockFlags |= flagsEnd;
+        for (int half = 0; half < 2; half++) {
+            loadTransposed8(inputs, block * 64 + half * 32, lo);
+            loadTransposed8(inputs + 8, block * 64 + half * 32, hi);
+            for (int i = 0; i < 8; i++) {
+                m[half * 8 + i] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[i]), hi[i], 1);
+            }
+        }
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm512_set1_epi32(BLAKE3_IV[i]);
+        v[12] = _mm512_loadu_si512((const void*)counterLo);
+        v[13] = _mm512_loadu_si512((const void*)counterHi);
+        v[14] = _mm512_set1_epi32(64);
+        v[15] = _mm512_set1_epi32(blockFlags);
+        for (int r = 0; r < 7; r++) {
+            const uint8_t* s = BLAKE3_MSG_SCHEDULE[r];
+            BLAKE3_AVX512_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+            BLAKE3_AVX512_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+            BLAKE3_AVX512_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+            BLAKE3_AVX512_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+            BLAKE3_AVX512_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+            BLAKE3_AVX512_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+            BLAKE3_AVX512_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+            BLAKE3_AVX512_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) h[i] = _mm512_xor_si512(v[i], v[i + 8]);
+        blockFlags = flags;
+    }
+    uint32_t words[128];
+    for (int i = 0; i < 8; i++) {
+        _mm512_storeu_si512((void*)(words + i * 16), h[i]);
+    }
+    blake3StoreCvs(words, 16, out);
+}
+// Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction (Intel, 2009),
+// with the bit-reflected constants of the CRC-32 polynomial.
+HASH_LIB_TARGET("sse4.1,pclmul")
+uint32_t hash_lib::internal::crc32Pclmul(uint32_t crc, const uint8_t* m, size_t len) {
+    if (len < 64) return crc32Software(crc, m, len);
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(m + 0)), _mm_cvtsi32_si128((int)crc));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(m + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(m + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(m + 48));
+    m += 64;
+    len -= 64;
+    // Fold 4 lanes of 128 bits by 512 bits.
+    while (len >= 64) {
+        __m128i t1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i t2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i t3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i t4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, t1), _mm_loadu_si128((const __m128i*)(m + 0)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, t2), _mm_loadu_si128((const __m128i*)(m + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, t3), _mm_loadu_si128((const __m128i*)(m + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, t4), _mm_loadu_si128((const __m128i*)(m + 48)));
+        m += 64;
+        len -= 64;
+    }
+    // Fold the 4 lanes into one, then fold the remaining 16-byte blocks.
+#define CRC32_FOLD128(x, next) \
+        t = _mm_clmulepi64_si128(x, k3k4, 0x00); \
+        x = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k3k4, 0x11), next), t);
+    __m128i t;
+    CRC32_FOLD128(x1, x2);
+    CRC32_FOLD128(x1, x3);
+    CRC32_FOLD128(x1, x4);
+    while (len >= 16) {
+        CRC32_FOLD128(x1, _mm_loadu_si128((const __m128i*)m));
+        m += 16;
+        len -= 16;
+    }
+#undef CRC32_FOLD128
+    // Fold 128 bits to 64 bits.
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00), x2);
+    // Barrett reduction to 32 bits.
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    crc = (uint32_t)_mm_extract_epi32(_mm_xor_si128(x1, x2), 1);
+    return crc32Software(crc, m, len);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_WORD uint64_t
+#define CRC32C_STEP(crc, p) crc = _mm_crc32_u64(crc, *(const uint64_t*)(p))
+#else
+#define CRC32C_WORD uint32_t
+#define CRC32C_STEP(crc, p) crc = _mm_crc32_u32(crc, *(const uint32_t*)(p))
+#endif
+
+static inline uint32_t crc32cShift(const uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+// The crc32 instruction has a latency of 3 cycles and a throughput of 1 per cycle,
+// so 3 independent streams are hashed at once and merged with the shift tables.
+HASH_LIB_TARGET("sse4.2")
+uint32_t hash_lib::internal::crc32cSse42(uint32_t crc, const uint8_t* m, size_t len) {
+    CRC32C_WORD crc0 = crc, crc1, crc2;
+    while (len && ((uintptr_t)m & (sizeof(CRC32C_WORD) - 1))) {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *m++);
+        len--;
+    }
+    const CRC32CShiftTables& tables = crc32cShiftTables();
+    const size_t streams[2] = { CRC32C_LONG, CRC32C_SHORT };
+    for (int s = 0; s < 2; s++) {
+        size_t n = streams[s];
+        const uint32_t (*shift)[256] = s == 0 ? tables.longShift : tables.shortShift;
+        while (len >= n * 3) {
+            crc1 = crc2 = 0;
+            const uint8_t* end = m + n;
+            do {
+                CRC32C_STEP(crc0, m);
+                CRC32C_STEP(crc1, m + n);
+                CRC32C_STEP(crc2, m + n * 2);
+                m += sizeof(CRC32C_WORD);
+            } while (m < end);
+            crc0 = crc32cShift(shift, (uint32_t)crc0) ^ (uint32_t)crc1;
+            crc0 = crc32cShift(shift, (uint32_t)crc0) ^ (uint32_t)crc2;
+            m += n * 2;
+            len -= n * 3;
+        }
+    }
+    while (len >= sizeof(CRC32C_WORD)) {
+        CRC32C_STEP(crc0, m);
+        m += sizeof(CRC32C_WORD);
+        len -= sizeof(CRC32C_WORD);
+    }
+    while (len--) {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *m++);
+    }
+    return (uint32_t)crc0;
+}
+#define XXH3_PRIME32_1 0x9E3779B1U
+
+// acc[i ^ 1] += data[i], acc[i] += lo32(data[i] ^ key[i]) * hi32(data[i] ^ key[i])
+HASH_LIB_TARGET("sse2")
+void hash_lib::internal::xxh3AccumulateSse2(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes) {
+    __m128i a[4];
+    for (int i = 0; i < 4; i++) a[i] = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+    for (size_t s = 0; s < stripes; s++) {
+        const uint8_t* in = input + s * 64;
+        const uint8_t* key = secret + s * 8;
+        for (int i = 0; i < 4; i++) {
+            __m128i data = _mm_loadu_si128((const __m128i*)(in + 16 * i));
+            __m128i dataKey = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + 16 * i)));
+            __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+        }
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_si128((__m128i*)(acc + 2 * i), a[i]);
+}
+
+HASH_LIB_TARGET("sse2")
+void hash_lib::internal::xxh3ScrambleSse2(uint64_t acc[8], const uint8_t* secret) {
+    const __m128i prime = _mm_set1_epi32((int)XXH3_PRIME32_1);
+    for (int i = 0; i < 4; i++) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+        __m128i hi = _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m128i productLo = _mm_mul_epu32(a, prime);
+        __m128i productHi = _mm_mul_epu32(hi, prime);
+        a = _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+        _mm_storeu_si128((__m128i*)(acc + 2 * i), a);
+    }
+}
+
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::xxh3AccumulateAvx2(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, size_t stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+    for (size_t s = 0; s < stripes; s++) {
+        const uint8_t* in = input + s * 64;
+        const uint8_t* key = secret + s * 8;
+        __m256i data0 = _mm256_loadu_si256((const __m256i*)in);
+        __m256i data1 = _mm256_loadu_si256((const __m256i*)(in + 32));
+        __m256i dataKey0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i*)key));
+        __m256i dataKey1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i*)(key + 32)));
+        __m256i product0 = _mm256_mul_epu32(dataKey0, _mm256_shuffle_epi32(dataKey0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i product1 = _mm256_mul_epu32(dataKey1, _mm256_shuffle_epi32(dataKey1, _MM_SHUFFLE(0, 3, 0, 1)));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(product0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(product1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    _mm256_storeu_si256((__m256i*)acc, a0);
+    _mm256_storeu_si256((__m256i*)(acc + 4), a1);
+}
+
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::xxh3ScrambleAvx2(uint64_t acc[8], const uint8_t* secret) {
+    const __m256i prime = _mm256_set1_epi32((int)XXH3_PRIME32_1);
+    for (int i = 0; i < 2; i++) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + 4 * i));
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)(secret + 32 * i)));
+        __m256i hi = _mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m256i productLo = _mm256_mul_epu32(a, prime);
+        __m256i productHi = _mm256_mul_epu32(hi, prime);
+        a = _mm256_add_epi64(productLo, _mm256_slli_epi64(productHi, 32));
+        _mm256_storeu_si256((__m256i*)(acc + 4 * i), a);
+    }
+}
+#define KECCAK_X4_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - (n)))
+#define KECCAK_X4_XOR5(a, b, c, d, e) _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), e)
+#define KECCAK_X4_CHI(E, i, B0, B1, B2, B3, B4) \
+        E[i] = _mm256_xor_si256(B0, _mm256_andnot_si256(B1, B2)); \
+        E[i + 1] = _mm256_xor_si256(B1, _mm256_andnot_si256(B2, B3)); \
+        E[i + 2] = _mm256_xor_si256(B2, _mm256_andnot_si256(B3, B4)); \
+        E[i + 3] = _mm256_xor_si256(B3, _mm256_andnot_si256(B4, B0)); \
+        E[i + 4] = _mm256_xor_si256(B4, _mm256_andnot_si256(B0, B1));
+// Same round as KECCAK_ROUND in hash_lib.cpp, on 4 states at once
+#define KECCAK_X4_ROUND(A, E, rc) { \
+        __m256i C0 = KECCAK_X4_XOR5(A[0], A[5], A[10], A[15], A[20]); \
+        __m256i C1 = KECCAK_X4_XOR5(A[1], A[6], A[11], A[16], A[21]); \
+        __m256i C2 = KECCAK_X4_XOR5(A[2], A[7], A[12], A[17], A[22]); \
+        __m256i C3 = KECCAK_X4_XOR5(A[3], A[8], A[13], A[18], A[23]); \
+        __m256i C4 = KECCAK_X4_XOR5(A[4], A[9], A[14], A[19], A[24]); \
+        __m256i D0 = _mm256_xor_si256(C4, KECCAK_X4_ROTL(C1, 1)); \
+        __m256i D1 = _mm256_xor_si256(C0, KECCAK_X4_ROTL(C2, 1)); \
+        __m256i D2 = _mm256_xor_si256(C1, KECCAK_X4_ROTL(C3, 1)); \
+        __m256i D3 = _mm256_xor_si256(C2, KECCAK_X4_ROTL(C4, 1)); \
+        __m256i D4 = _mm256_xor_si256(C3, KECCAK_X4_ROTL(C0, 1)); \
+        __m256i B0, B1, B2, B3, B4; \
+        B0 = _mm256_xor_si256(A[0], D0); \
+        B1 = KECCAK_X4_ROTL(_mm256_xor_si256(A[6], D1), 44); \
+        B2 = KECCAK_X4_ROTL(_mm256_xor_si256(A[12], D2), 43); \
+        B3 = KECCAK_X4_ROTL(_mm256_xor_si256(A[18], D3), 21); \
+        B4 = KECCAK_X4_ROTL(_mm256_xor_si256(A[24], D4), 14); \
+        KECCAK_X4_CHI(E, 0, B0, B1, B2, B3, B4); \
+        E[0] = _mm256_xor_si256(E[0], _mm256_set1_epi64x((long long)(rc))); \
+        B0 = KECCAK_X4_ROTL(_mm256_xor_si256(A[3], D3), 28); \
+        B1 = KECCAK_X4_ROTL(_mm256_xor_si256(A[9], D4), 20); \
+        B2 = KECCAK_X4_ROTL(_mm256_xor_si256(A[10], D0), 3); \
+        B3 = KECCAK_X4_ROTL(_mm256_xor_si256(A[16], D1), 45); \
+        B4 = KECCAK_X4_ROTL(_mm256_xor_si256(A[22], D2), 61); \
+        KECCAK_X4_CHI(E, 5, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_X4_ROTL(_mm256_xor_si256(A[1], D1), 1); \
+        B1 = KECCAK_X4_ROTL(_mm256_xor_si256(A[7], D2), 6); \
+        B2 = KECCAK_X4_ROTL(_mm256_xor_si256(A[13], D3), 25); \
+        B3 = KECCAK_X4_ROTL(_mm256_xor_si256(A[19], D4), 8); \
+        B4 = KECCAK_X4_ROTL(_mm256_xor_si256(A[20], D0), 18); \
+        KECCAK_X4_CHI(E, 10, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_X4_ROTL(_mm256_xor_si256(A[4], D4), 27); \
+        B1 = KECCAK_X4_ROTL(_mm256_xor_si256(A[5], D0), 36); \
+        B2 = KECCAK_X4_ROTL(_mm256_xor_si256(A[11], D1), 10); \
+        B3 = KECCAK_X4_ROTL(_mm256_xor_si256(A[17], D2), 15); \
+        B4 = KECCAK_X4_ROTL(_mm256_xor_si256(A[23], D3), 56); \
+        KECCAK_X4_CHI(E, 15, B0, B1, B2, B3, B4); \
+        B0 = KECCAK_X4_ROTL(_mm256_xor_si256(A[2], D2), 62); \
+        B1 = KECCAK_X4_ROTL(_mm256_xor_si256(A[8], D3), 55); \
+        B2 = KECCAK_X4_ROTL(_mm256_xor_si256(A[14], D4), 39); \
+        B3 = KECCAK_X4_ROTL(_mm256_xor_si256(A[15], D0), 41); \
+        B4 = KECCAK_X4_ROTL(_mm256_xor_si256(A[21], D1), 2); \
+        KECCAK_X4_CHI(E, 20, B0, B1, B2, B3, B4); \
+    }
+
+HASH_LIB_TARGET("avx2")
+void hash_lib::internal::keccakX4AbsorbAvx2(uint64_t* state, const uint8_t* const* m, size_t blocks, size_t rate) {
+    __m256i a[25], e[25];
+    for (int i = 0; i < 25; i++) {
+        a[i] = _mm256_loadu_si256((const __m256i*)(state + i * 4));
+    }
+    size_t offset = 0;
+    while (blocks--) {
+        for (size_t i = 0; i < rate / 8; i++) {
+            uint64_t w[4];
+            for (int j = 0; j < 4; j++) {
+                memcpy(&w[j], m[j] + offset + i * 8, 8);
+            }
+            a[i] = _mm256_xor_si256(a[i], _mm256_loadu_si256((const __m256i*)w));
+        }
+        for (int round = 0; round < 24; round += 2) {
+            KECCAK_X4_ROUND(a, e, KECCAK_RC[round]);
+            KECCAK_X4_ROUND(e, a, KECCAK_RC[round + 1]);
+        }
+        offset += rate;
+    }
+    for (int i = 0; i < 25; i++) {
+        _mm256_storeu_si256((__m256i*)(state + i * 4), a[i]);
+    }
+}
+#endif
@@ -45,7 +45,7 @@ struct hash_map {
     uint8_t loadfactor;
     struct hash_map_entry<K, V>** map;
     std::function<size_t(size_t)> probing;
-    std::hash<K> hash;
+    std::function<size_t(const K&)> hash;
     std::function<void(K)> free_key;
     std::function<void(V)> free_value;
 };
@@ -1,6 +1,14 @@
 #include "str_util.h"
 #include "cstr_util.h"
 #include <malloc.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STR_UTIL_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define STR_UTIL_NEON 1
+#endif
 
 #ifndef max
 #define max(a,b) (((a) > (b)) ? (a) : (b))
@@ -83,16 +91,118 @@ std::vector<std::string> str_util::str_splitv(std::string input, std::string pat
 
 std::string str_util::str_hex(std::string input) {
     if (input.empty()) return "";
-    const char* t = "0123456789abcdef";
-    std::string output;
-    for (auto i = input.begin(); i != input.end(); i++) {
-        unsigned char c = *i;
-        output += t[c / 16];
-        output += t[c % 16];
-    }
+    std::string output(input.size() * 2, 0);
+    str_hex(input.c_str(), input.size(), &output[0]);
     return output;
 }
 
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+void str_util::str_hex(const void* input, size_t len, char* output) {
+    const uint8_t* in = (const uint8_t*)input;
+    size_t i = 0;
+#if STR_UTIL_SSE2
+    const __m128i mask = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9), zero = _mm_set1_epi8('0'), letter = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+        __m128i a = _mm_unpacklo_epi8(hi, lo), b = _mm_unpackhi_epi8(hi, lo);
+        // nibble + '0', plus the gap to 'a' for nibbles above 9
+        a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), letter));
+        b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), letter));
+        _mm_storeu_si128((__m128i*)(output + i * 2), a);
+        _mm_storeu_si128((__m128i*)(output + i * 2 + 16), b);
+    }
+#elif STR_UTIL_NEON
+    const uint8x16_t table = vld1q_u8((const uint8_t*)HEX_DIGITS);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16x2_t re;
+        re.val[0] = vqtbl1q_u8(table, vshrq_n_u8(v, 4));
+        re.val[1] = vqtbl1q_u8(table, vandq_u8(v, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t*)output + i * 2, re);
+    }
+#endif
+    for (; i < len; i++) {
+        output[i * 2] = HEX_DIGITS[in[i] >> 4];
+        output[i * 2 + 1] = HEX_DIGITS[in[i] & 0x0f];
+    }
+}
+
+// Value of a hexadecimal character, or -1
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+#if STR_UTIL_SSE2
+// Convert 16 hexadecimal characters to nibbles, invalid characters set bits of err
+static inline __m128i hex_nibbles_sse2(__m128i c, __m128i& err) {
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    // Unsigned x <= n is min(x, n) == x
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+    err = _mm_or_si128(err, _mm_andnot_si128(_mm_or_si128(isDigit, isAlpha), _mm_set1_epi8(-1)));
+    return _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_andnot_si128(isDigit, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+#endif
+
+#if STR_UTIL_NEON
+static inline uint8x16_t hex_nibbles_neon(uint8x16_t c, uint8x16_t& err) {
+    uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t isDigit = vcleq_u8(digit, vdupq_n_u8(9));
+    uint8x16_t isAlpha = vcleq_u8(alpha, vdupq_n_u8(5));
+    err = vorrq_u8(err, vmvnq_u8(vorrq_u8(isDigit, isAlpha)));
+    return vbslq_u8(isDigit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+#endif
+
+bool str_util::str_unhex(const char* input, size_t len, void* output) {
+    if (len % 2) return false;
+    uint8_t* out = (uint8_t*)output;
+    size_t n = len / 2, i = 0;
+#if STR_UTIL_SSE2
+    __m128i err = _mm_setzero_si128();
+    const __m128i low = _mm_set1_epi16(0xff);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = hex_nibbles_sse2(_mm_loadu_si128((const __m128i*)(input + i * 2)), err);
+        __m128i b = hex_nibbles_sse2(_mm_loadu_si128((const __m128i*)(input + i * 2 + 16)), err);
+        // The high nibble is the first (low) byte of each 16-bit lane
+        a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low), 4), _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low), 4), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+    }
+    if (_mm_movemask_epi8(err)) return false;
+#elif STR_UTIL_NEON
+    uint8x16_t err = vdupq_n_u8(0);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t c = vld2q_u8((const uint8_t*)input + i * 2);
+        uint8x16_t hi = hex_nibbles_neon(c.val[0], err);
+        uint8x16_t lo = hex_nibbles_neon(c.val[1], err);
+        vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+    if (vmaxvq_u8(err)) return false;
+#endif
+    for (; i < n; i++) {
+        int hi = hex_value(input[i * 2]), lo = hex_value(input[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+bool str_util::str_unhex(std::string input, std::string& output) {
+    std::string re(input.size() / 2, 0);
+    if (!str_unhex(input.c_str(), input.size(), &re[0])) return false;
+    output = re;
+    return true;
+}
+
 bool str_util::str_endswith(std::string input, std::string pattern) {
     auto ilen = input.length();
     auto plen = pattern.length();
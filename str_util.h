@@ -53,6 +53,28 @@ namespace str_util {
      * @return Output
     */
     std::string str_hex(std::string input);
+    /**
+     * @brief Convert data to lowercase hexadecimal without allocating (SSE2 or NEON when available)
+     * @param input Input data
+     * @param len Length of the input data
+     * @param output Output buffer of at least len * 2 chars, no null terminator is written
+    */
+    void str_hex(const void* input, size_t len, char* output);
+    /**
+     * @brief Convert a hexadecimal string (lowercase or uppercase) to data
+     * @param input Input string
+     * @param len Length of the input string, must be even
+     * @param output Output buffer of at least len / 2 bytes
+     * @return false if the input contains a non hexadecimal character or has an odd length
+    */
+    bool str_unhex(const char* input, size_t len, void* output);
+    /**
+     * @brief Convert a hexadecimal string (lowercase or uppercase) to data
+     * @param input Input string
+     * @param output Output data
+     * @return false if the input is not a valid hexadecimal string
+    */
+    bool str_unhex(std::string input, std::string& output);
     /**
      * @brief Check if a string ends with a pattern
      * @param input Input data
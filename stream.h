@@ -6,9 +6,18 @@
 #include <vector>
 #include <string.h>
 #include "cstr_util.h"
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <memory>
 #include <mutex>
 #if _WIN32
 #include <fcntl.h>
+#include <io.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
 #ifndef _SH_DENYWR
 #define _SH_DENYWR 0x20
 #endif
@@ -18,6 +27,11 @@
 #ifndef _O_RDONLY
 #define _O_RDONLY 0x0000
 #endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 class ReadStream {
@@ -105,10 +119,7 @@ public:
 class FileReadStream : public ReadStream {
 public:
     virtual ~FileReadStream() {
-        if (fp) {
-            fileop::fclose(fp);
-            fp = nullptr;
-        }
+        close();
     }
     /**
      * @brief Open a file for reading
@@ -126,6 +137,12 @@ public:
         if (!fp) {
             errored = true;
             fileop::close(fd);
+            return;
+        }
+        // A second handle for read_at: overlapped reads run concurrently and do not move the position of fp.
+        HANDLE file = (HANDLE)_get_osfhandle(fd);
+        if (file != INVALID_HANDLE_VALUE) {
+            positional = ReOpenFile(file, GENERIC_READ, FILE_SHARE_READ, FILE_FLAG_OVERLAPPED);
         }
 #else
         fp = fileop::fopen(filename, "rb");
@@ -164,6 +181,12 @@ public:
         return errored;
     }
     virtual bool close() {
+#if _WIN32
+        if (positional != INVALID_HANDLE_VALUE) {
+            CloseHandle(positional);
+            positional = INVALID_HANDLE_VALUE;
+        }
+#endif
         if (!fp) return true;
         bool res = fileop::fclose(fp);
         fp = nullptr;
@@ -171,39 +194,254 @@ public:
     }
 
     // Read at absolute offset without modifying stream position for other users.
+    // Positional reads (pread, or overlapped ReadFile on Windows) need no lock, so concurrent calls scale.
     virtual size_t read_at(uint8_t* buf, size_t size, int64_t offset) override {
-        if (!fp) return 0;
-        std::lock_guard<std::mutex> guard(io_mutex);
-        if (fileop::fseek(fp, offset, SEEK_SET) != 0) {
+        if (!fp || offset < 0) return 0;
+        size_t readed = 0;
+#if _WIN32
+        if (positional == INVALID_HANDLE_VALUE) {
+            // The file can not be reopened, fall back to seeking fp.
+            std::lock_guard<std::mutex> guard(io_mutex);
+            if (fileop::fseek(fp, offset, SEEK_SET) != 0) {
+                errored = true;
+                return 0;
+            }
+            readed = fread(buf, 1, size, fp);
+            if (readed != size && ferror(fp)) {
+                errored = true;
+            }
+            return readed;
+        }
+        HANDLE event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!event) {
             errored = true;
             return 0;
         }
-        size_t readed = fread(buf, 1, size, fp);
-        if (readed != size && ferror(fp)) {
-            errored = true;
+        while (readed < size) {
+            uint64_t pos = (uint64_t)offset + readed;
+            DWORD to_read = size - readed > 0x40000000 ? 0x40000000 : (DWORD)(size - readed);
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)pos;
+            ov.OffsetHigh = (DWORD)(pos >> 32);
+            ov.hEvent = event;
+            DWORD r = 0;
+            if (!ReadFile(positional, buf + readed, to_read, &r, &ov)) {
+                DWORD err = GetLastError();
+                if (err == ERROR_IO_PENDING) {
+                    if (!GetOverlappedResult(positional, &ov, &r, TRUE)) err = GetLastError();
+                    else err = ERROR_SUCCESS;
+                }
+                if (err == ERROR_HANDLE_EOF) break;
+                if (err != ERROR_SUCCESS) {
+                    errored = true;
+                    break;
+                }
+            }
+            if (r == 0) break;
+            readed += r;
+        }
+        CloseHandle(event);
+#else
+        int fd = fileno(fp);
+        while (readed < size) {
+            ssize_t r = pread(fd, buf + readed, size - readed, (off_t)(offset + readed));
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                errored = true;
+                break;
+            }
+            if (r == 0) break;
+            readed += r;
         }
+#endif
         return readed;
     }
 
 private:
     FILE* fp = nullptr;
-    bool errored = false;
+    std::atomic<bool> errored { false };
+#if _WIN32
+    HANDLE positional = INVALID_HANDLE_VALUE;
     std::mutex io_mutex;
+#endif
+};
+
+class MmapReadStream : public ReadStream {
+public:
+    virtual ~MmapReadStream() {
+        close();
+    }
+    /**
+     * @brief Map a file read-only. Reads are copies from the mapping, data() and view() give access without copying.
+     * The file must not be truncated while it is mapped.
+     * @param filename File name (on Windows, UTF-8 encoding is supported)
+    */
+    MmapReadStream(const char* filename) {
+        int fd = -1;
+#if _WIN32
+        if (fileop::open(filename, fd, _O_RDONLY | _O_BINARY, _SH_DENYWR) != 0) {
+            errored = true;
+            return;
+        }
+        HANDLE file = (HANDLE)_get_osfhandle(fd);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > (size_t)-1) {
+            errored = true;
+            fileop::close(fd);
+            return;
+        }
+        length = (size_t)size.QuadPart;
+        if (length) {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                map = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                // The view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+            if (!map) errored = true;
+        }
+#else
+        if (fileop::open(filename, fd, O_RDONLY) != 0) {
+            errored = true;
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > (size_t)-1) {
+            errored = true;
+            fileop::close(fd);
+            return;
+        }
+        length = (size_t)st.st_size;
+        if (length) {
+            void* m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) {
+                errored = true;
+            } else {
+                map = (const uint8_t*)m;
+            }
+        }
+#endif
+        fileop::close(fd);
+        opened = !errored;
+    }
+    MmapReadStream(const MmapReadStream&) = delete;
+    MmapReadStream& operator=(const MmapReadStream&) = delete;
+
+    virtual size_t read(uint8_t* buf, size_t size) override {
+        size_t readed = read_at(buf, size, (int64_t)pos);
+        pos += readed;
+        return readed;
+    }
+
+    // Copy from the mapping, safe to call from multiple threads.
+    virtual size_t read_at(uint8_t* buf, size_t size, int64_t offset) override {
+        if (!opened || offset < 0 || (uint64_t)offset >= length) return 0;
+        size_t remaining = length - (size_t)offset;
+        size_t to_read = remaining < size ? remaining : size;
+        memcpy(buf, map + offset, to_read);
+        return to_read;
+    }
+
+    virtual bool seek(int64_t offset, int whence) override {
+        if (!opened) return false;
+        int64_t new_pos;
+        switch (whence) {
+            case SEEK_SET:
+                new_pos = offset;
+                break;
+            case SEEK_CUR:
+                new_pos = (int64_t)pos + offset;
+                break;
+            case SEEK_END:
+                new_pos = (int64_t)length + offset;
+                break;
+            default:
+                return false;
+        }
+        if (new_pos < 0 || new_pos > (int64_t)length) {
+            return false;
+        }
+        pos = (size_t)new_pos;
+        return true;
+    }
+
+    virtual int64_t tell() override {
+        return opened ? (int64_t)pos : -1;
+    }
+
+    virtual bool seekable() override {
+        return opened;
+    }
+
+    virtual bool eof() override {
+        return !opened || pos >= length;
+    }
+
+    virtual bool error() override {
+        return errored;
+    }
+
+    virtual bool close() override {
+        if (map) {
+#if _WIN32
+            UnmapViewOfFile(map);
+#else
+            munmap((void*)map, length);
+#endif
+            map = nullptr;
+        }
+        opened = false;
+        return true;
+    }
+
+    /**
+     * @brief The whole mapped file, valid until the stream is closed
+     * @return nullptr if the file is empty or not mapped
+    */
+    const uint8_t* data() const {
+        return map;
+    }
+    size_t size() const {
+        return length;
+    }
+    /**
+     * @brief Access a range of the file without copying, valid until the stream is closed
+     * @param offset Offset of the range
+     * @param len Length of the range
+     * @return nullptr if the range is not inside the file
+    */
+    const uint8_t* view(uint64_t offset, size_t len) const {
+        if (!map || offset > length || len > length - offset) return nullptr;
+        return map + offset;
+    }
+
+private:
+    const uint8_t* map = nullptr;
+    size_t length = 0;
+    size_t pos = 0;
+    bool opened = false;
+    bool errored = false;
 };
 
 class MemReadStream : public ReadStream {
 public:
-    MemReadStream(const std::vector<uint8_t>& data) : data(data), pos(0) {}
+    MemReadStream(const std::vector<uint8_t>& data) : buffer(data), pos(0) {}
     
-    MemReadStream(std::vector<uint8_t>&& data) : data(std::move(data)), pos(0) {}
+    MemReadStream(std::vector<uint8_t>&& data) : buffer(std::move(data)), pos(0) {}
+
+    // Moves take the buffer without copying it, use MemViewReadStream to read a buffer owned elsewhere.
+    MemReadStream(MemReadStream&&) = default;
+    MemReadStream& operator=(MemReadStream&&) = default;
+    MemReadStream(const MemReadStream&) = default;
+    MemReadStream& operator=(const MemReadStream&) = default;
 
     virtual size_t read(uint8_t* buf, size_t size) override {
-        if (pos >= data.size()) return 0;
+        if (pos >= buffer.size()) return 0;
         
-        size_t remaining = data.size() - pos;
+        size_t remaining = buffer.size() - pos;
         size_t to_read = remaining < size ? remaining : size;
         
-        memcpy(buf, data.data() + pos, to_read);
+        memcpy(buf, buffer.data() + pos, to_read);
         pos += to_read;
         
         return to_read;
@@ -213,10 +451,10 @@ public:
     virtual size_t read_at(uint8_t* buf, size_t size, int64_t offset) override {
         if (offset < 0) return 0;
         size_t uoffset = (size_t)offset;
-        if (uoffset >= data.size()) return 0;
-        size_t remaining = data.size() - uoffset;
+        if (uoffset >= buffer.size()) return 0;
+        size_t remaining = buffer.size() - uoffset;
         size_t to_read = remaining < size ? remaining : size;
-        memcpy(buf, data.data() + uoffset, to_read);
+        memcpy(buf, buffer.data() + uoffset, to_read);
         return to_read;
     }
 
@@ -230,13 +468,13 @@ public:
                 new_pos = pos + offset;
                 break;
             case SEEK_END:
-                new_pos = data.size() + offset;
+                new_pos = buffer.size() + offset;
                 break;
             default:
                 return false;
         }
         
-        if (new_pos < 0 || new_pos > (int64_t)data.size()) {
+        if (new_pos < 0 || new_pos > (int64_t)buffer.size()) {
             return false;
         }
         
@@ -253,7 +491,7 @@ public:
     }
 
     virtual bool eof() override {
-        return pos >= data.size();
+        return pos >= buffer.size();
     }
 
     virtual bool error() override {
@@ -264,8 +502,121 @@ public:
         return true;
     }
 
+    const uint8_t* data() const {
+        return buffer.data();
+    }
+    size_t size() const {
+        return buffer.size();
+    }
+
 private:
-    const std::vector<uint8_t> data;
+    std::vector<uint8_t> buffer;
+    size_t pos = 0;
+};
+
+class MemViewReadStream : public ReadStream {
+public:
+    /**
+     * @brief Read a buffer without copying or owning it, the buffer must outlive the stream
+     * @param data Buffer
+     * @param size Size of the buffer
+    */
+    MemViewReadStream(const uint8_t* data, size_t size) : ptr(data), length(data ? size : 0) {}
+    /**
+     * @brief Read a buffer kept alive by the stream
+     * @param owner Owner of the buffer, e.g. the shared_ptr it was allocated with
+     * @param data Buffer inside owner
+     * @param size Size of the buffer
+    */
+    MemViewReadStream(std::shared_ptr<const void> owner, const uint8_t* data, size_t size) :
+        owner(std::move(owner)), ptr(data), length(data ? size : 0) {}
+    /**
+     * @brief Read a shared vector, the stream keeps it alive
+     * @param data Vector, it must not be resized while the stream is used
+    */
+    MemViewReadStream(std::shared_ptr<const std::vector<uint8_t>> data) :
+        ptr(data ? data->data() : nullptr), length(data ? data->size() : 0) {
+        owner = std::move(data);
+    }
+
+    virtual size_t read(uint8_t* buf, size_t size) override {
+        size_t readed = read_at(buf, size, (int64_t)pos);
+        pos += readed;
+        return readed;
+    }
+
+    // Copy from the buffer, safe to call from multiple threads.
+    virtual size_t read_at(uint8_t* buf, size_t size, int64_t offset) override {
+        if (offset < 0 || (uint64_t)offset >= length) return 0;
+        size_t remaining = length - (size_t)offset;
+        size_t to_read = remaining < size ? remaining : size;
+        memcpy(buf, ptr + offset, to_read);
+        return to_read;
+    }
+
+    virtual bool seek(int64_t offset, int whence) override {
+        int64_t new_pos;
+        switch (whence) {
+            case SEEK_SET:
+                new_pos = offset;
+                break;
+            case SEEK_CUR:
+                new_pos = (int64_t)pos + offset;
+                break;
+            case SEEK_END:
+                new_pos = (int64_t)length + offset;
+                break;
+            default:
+                return false;
+        }
+        if (new_pos < 0 || new_pos > (int64_t)length) {
+            return false;
+        }
+        pos = (size_t)new_pos;
+        return true;
+    }
+
+    virtual int64_t tell() override {
+        return (int64_t)pos;
+    }
+
+    virtual bool seekable() override {
+        return true;
+    }
+
+    virtual bool eof() override {
+        return pos >= length;
+    }
+
+    virtual bool error() override {
+        return false;
+    }
+
+    virtual bool close() override {
+        return true;
+    }
+
+    const uint8_t* data() const {
+        return ptr;
+    }
+    size_t size() const {
+        return length;
+    }
+    /**
+     * @brief Access a range of the buffer without copying
+     * @param offset Offset of the range
+     * @param len Length of the range
+     * @return nullptr if the range is not inside the buffer
+    */
+    const uint8_t* view(uint64_t offset, size_t len) const {
+        if (!ptr || offset > length || len > length - offset) return nullptr;
+        return ptr + offset;
+    }
+
+private:
+    std::shared_ptr<const void> owner;
+    const uint8_t* ptr = nullptr;
+    size_t length = 0;
     size_t pos = 0;
 };
 
@@ -368,4 +719,203 @@ private:
     int64_t current_pos;
     bool errored = false;
 };
+
+class BufferedReadStream : public ReadStream {
+public:
+    /**
+     * @brief Buffer small reads of a stream in a ring buffer. The source is not owned, it must outlive this stream
+     * and must not be read directly while this stream is used.
+     * @param source Stream to read
+     * @param capacity Size of the ring buffer, the largest readahead and peek
+     * @param min_readahead Readahead after a random seek, it doubles on every refill of sequential reads up to capacity
+    */
+    BufferedReadStream(ReadStream* source, size_t capacity = 64 << 10, size_t min_readahead = 4096)
+        : source(source), buffer(capacity ? capacity : 1) {
+        readahead_min = min_readahead ? min_readahead : 1;
+        if (readahead_min > buffer.size()) readahead_min = buffer.size();
+        readahead = readahead_min;
+        if (!source) {
+            errored = true;
+            return;
+        }
+        int64_t p = source->tell();
+        positioned = p >= 0;
+        pos = positioned ? p : 0;
+    }
+
+    virtual size_t read(uint8_t* buf, size_t size) override {
+        if (!source || size == 0) return 0;
+        size_t readed = take(buf, size);
+        if (readed == size) return readed;
+        // The buffer is empty now, large reads bypass it
+        if (size - readed >= readahead) {
+            size_t r = source->read(buf + readed, size - readed);
+            // The consumed bytes in the buffer no longer precede the position
+            back = 0;
+            pos += r;
+            return readed + r;
+        }
+        fill(size - readed);
+        return readed + take(buf + readed, size - readed);
+    }
+
+    // Forwarded to the source, whose read_at must not move its position (as for all streams of this file).
+    virtual size_t read_at(uint8_t* buf, size_t size, int64_t offset) override {
+        if (!source) return 0;
+        return source->read_at(buf, size, offset);
+    }
+
+    /**
+     * @brief Look at the next bytes without consuming them, reading from the source if needed
+     * @param n Count of bytes, at most the capacity of the buffer
+     * @return nullptr if fewer than n bytes are left, the pointer is valid until the next call on this stream
+    */
+    const uint8_t* peek(size_t n) {
+        if (!source || n > buffer.size()) return nullptr;
+        if (avail < n) fill(n);
+        if (avail < n) return nullptr;
+        if (head + n > buffer.size()) {
+            // Make the bytes contiguous, the consumed bytes before head stay before it
+            std::rotate(buffer.begin(), buffer.begin() + head, buffer.end());
+            head = 0;
+        }
+        return buffer.data() + head;
+    }
+
+    // Seeks inside the buffered (or recently consumed) bytes do not touch the source.
+    virtual bool seek(int64_t offset, int whence) override {
+        if (!source) return false;
+        int64_t target;
+        switch (whence) {
+            case SEEK_SET:
+                if (!positioned) return false;
+                target = offset;
+                break;
+            case SEEK_CUR:
+                target = pos + offset;
+                break;
+            case SEEK_END: {
+                if (!source->seek(offset, SEEK_END)) return false;
+                int64_t p = source->tell();
+                drop(p < 0 ? 0 : p, true);
+                return p >= 0;
+            }
+            default:
+                return false;
+        }
+        if (target >= pos - (int64_t)back && target <= pos + (int64_t)avail) {
+            size_t cap = buffer.size();
+            if (target >= pos) {
+                size_t delta = (size_t)(target - pos);
+                head = (head + delta) % cap;
+                avail -= delta;
+                back += delta;
+            } else {
+                size_t delta = (size_t)(pos - target);
+                head = (head + cap - delta) % cap;
+                avail += delta;
+                back -= delta;
+            }
+            pos = target;
+            return true;
+        }
+        if (!source->seek(target, SEEK_SET)) return false;
+        // Short forward skips keep the readahead of sequential reads
+        bool random = target < pos || target - (pos + (int64_t)avail) > (int64_t)readahead;
+        drop(target, random);
+        return true;
+    }
+
+    virtual int64_t tell() override {
+        return positioned ? pos : -1;
+    }
+
+    virtual bool seekable() override {
+        return source && source->seekable();
+    }
+
+    virtual bool eof() override {
+        return !source || (avail == 0 && source->eof());
+    }
+
+    virtual bool error() override {
+        return errored || source->error();
+    }
+
+    virtual bool close() override {
+        // The source is not owned
+        drop(pos, true);
+        return true;
+    }
+
+    // Size of the next refill
+    size_t readahead_size() const {
+        return readahead;
+    }
+    // Count of bytes buffered after the position
+    size_t buffered() const {
+        return avail;
+    }
+
+private:
+    size_t take(uint8_t* buf, size_t size) {
+        size_t cap = buffer.size();
+        size_t n = avail < size ? avail : size;
+        size_t first = cap - head < n ? cap - head : n;
+        memcpy(buf, buffer.data() + head, first);
+        memcpy(buf + first, buffer.data(), n - first);
+        head = (head + n) % cap;
+        avail -= n;
+        back += n;
+        pos += n;
+        return n;
+    }
+
+    // Read from the source until want bytes are buffered, or the readahead if more.
+    void fill(size_t want) {
+        size_t cap = buffer.size();
+        if (avail == 0) {
+            if (sequential && readahead < cap) readahead = readahead * 2 < cap ? readahead * 2 : cap;
+            sequential = true;
+        }
+        size_t target = want > readahead ? want : readahead;
+        if (target > cap) target = cap;
+        while (avail < target) {
+            size_t tail = (head + avail) % cap;
+            size_t space = cap - avail;
+            size_t contiguous = cap - tail < space ? cap - tail : space;
+            size_t to_read = contiguous < target - avail ? contiguous : target - avail;
+            size_t r = source->read(buffer.data() + tail, to_read);
+            if (r == 0) break;
+            avail += r;
+            // Free space held consumed bytes
+            if (back > cap - avail) back = cap - avail;
+            if (avail >= want && r < to_read) break;
+        }
+    }
+
+    void drop(int64_t new_pos, bool random) {
+        head = 0;
+        avail = 0;
+        back = 0;
+        pos = new_pos;
+        if (random) {
+            readahead = readahead_min;
+            sequential = false;
+        }
+    }
+
+    ReadStream* source;
+    std::vector<uint8_t> buffer;
+    size_t head = 0;
+    size_t avail = 0;
+    // Count of consumed bytes before head which are still in the buffer
+    size_t back = 0;
+    int64_t pos = 0;
+    size_t readahead = 0;
+    size_t readahead_min = 0;
+    bool sequential = false;
+    bool positioned = false;
+    bool errored = false;
+};
 #endif
@@ -1,5 +1,14 @@
 #include "gtest/gtest.h"
 #include "hash_lib.h"
+#include <errno.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#if !_WIN32
+#include <unistd.h>
+#endif
 
 using namespace hash_lib;
 
@@ -25,6 +34,19 @@ TEST(HashLibTest, SHA512Test) {
     GTEST_ASSERT_EQ(hashHex<SHA512>("随便来一些中文。测试超过一百二十八字节时的状况。用于测试是否存在问题。还是不够长呢。啊啊啊。"), "216b232fc6db1bbdcac1ba59bda0732157d1005c6c5f3ac4cdff555ee013cf48b181a580d6ae3eda8dfd875448e06b1613494fd1bae20dbd8e2f2326634a147c");
 }
 
+TEST(HashLibTest, SHA512LongTest) {
+    std::string a(1000000, 'a');
+    GTEST_ASSERT_EQ(hashHex<SHA512>(a), "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+    GTEST_ASSERT_EQ(hashHex<SHA384>(a), "9d0e1809716474cb086e834e310a4a1ced149e9c00f248527972cec5704c2a5b07b8b3dc38ecc4ebae97ddd87f3d8985");
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i % 251;
+    SHA512 sha512;
+    for (size_t i = 0, step = 1; i < data.size(); i += step, step = step * 3 % 997) {
+        sha512.update(data.data() + i, std::min(step, data.size() - i));
+    }
+    GTEST_ASSERT_EQ(sha512.hexDigest(), "9a63314a71907982aa89ca2dfd6e22b5c5a436df3a7b55f93785d7f7971324a3fd500ae72e066a5367b1f2d407a820503c6e2f13df5885f83a49aedb0706db84");
+}
+
 TEST(HashLibTest, SHA512_256Test) {
     GTEST_ASSERT_EQ(hashHex<SHA512_256>("Hello, World!"), "0686f0a605973dc1bf035d1e2b9bad1985a0bff712ddd88abd8d2593e5f99030");
     GTEST_ASSERT_EQ(hashHex<SHA512_256>(""), "c672b8d1ef56ed28ab87c3622c5114069bdd3ad7b8f9737498d0c01ecef0967a");
@@ -43,6 +65,20 @@ TEST(HashLibTest, SHA256Test) {
     GTEST_ASSERT_EQ(hashHex<SHA256>("随便来一些中文。测试超过一百二十八字节时的状况。用于测试是否存在问题。还是不够长呢。啊啊啊。"), "29388dd3cd53f3921b3b842e1583980ef2e07a9a48262362decc5870b03fbf6d");
 }
 
+TEST(HashLibTest, SHA256LongTest) {
+    std::string a(1000000, 'a');
+    GTEST_ASSERT_EQ(hashHex<SHA256>(a), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    GTEST_ASSERT_EQ(hashHex<SHA224>(a), "20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67");
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i % 251;
+    SHA256 sha256;
+    for (size_t i = 0, step = 1; i < data.size(); i += step, step = step * 3 % 997) {
+        sha256.update(data.data() + i, std::min(step, data.size() - i));
+    }
+    GTEST_ASSERT_EQ(sha256.hexDigest(), "cd2df694e424bc7968cc37f47751019e5ca0cd1bdf2e479ea537c3a1c32ee1aa");
+    GTEST_ASSERT_EQ(hashHex<SHA256>(data), "cd2df694e424bc7968cc37f47751019e5ca0cd1bdf2e479ea537c3a1c32ee1aa");
+}
+
 TEST(HashLibTest, SHA224Test) {
     GTEST_ASSERT_EQ(hashHex<SHA224>(""), "d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f");
     GTEST_ASSERT_EQ(hashHex<SHA224>("Hello, World!"), "72a23dfa411ba6fde01dbfabf3b00a709c93ebf273dc29e2d8b261ff");
@@ -55,12 +91,79 @@ TEST(HashLibTest, SHA1Test) {
     GTEST_ASSERT_EQ(hashHex<SHA1>("随便来一些中文。测试超过一百二十八字节时的状况。用于测试是否存在问题。还是不够长呢。啊啊啊。"), "21c05e3532d593ec382b8e361d43a17e8fb8774a");
 }
 
+TEST(HashLibTest, SHA1LongTest) {
+    GTEST_ASSERT_EQ(hashHex<SHA1>(std::string(1000000, 'a')), "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i % 251;
+    GTEST_ASSERT_EQ(hashHex<SHA1>(data), "23a1065a0f6a485119049bf2799179dd0154efbb");
+}
+
+TEST(HashLibTest, HardwareAccelerationTest) {
+    std::vector<uint8_t> data(10000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i * 7 % 256;
+    setHardwareAcceleration(false);
+    auto sha1 = hashHex<SHA1>(data);
+    auto sha256 = hashHex<SHA256>(data);
+    auto sha512 = hashHex<SHA512>(data);
+    setHardwareAcceleration(true);
+    GTEST_ASSERT_TRUE(hardwareAcceleration());
+    GTEST_ASSERT_EQ(hashHex<SHA1>(data), sha1);
+    GTEST_ASSERT_EQ(hashHex<SHA256>(data), sha256);
+    GTEST_ASSERT_EQ(hashHex<SHA512>(data), sha512);
+}
+
+TEST(HashLibTest, HashBatchTest) {
+    std::vector<std::vector<uint8_t>> data;
+    for (size_t len = 0; len < 300; len += 7) {
+        std::vector<uint8_t> d(len);
+        for (size_t i = 0; i < len; i++) d[i] = (i + len) % 256;
+        data.push_back(d);
+    }
+    data.push_back(std::vector<uint8_t>(5000, 'x'));
+    auto sha256 = hashBatch<SHA256>(data);
+    auto sha224 = hashBatch<SHA224>(data);
+    auto sha1 = hashBatch<SHA1>(data);
+    auto hmac = hashBatch<HMAC<SHA256>>(data, "key");
+    GTEST_ASSERT_EQ(sha256.size(), data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        GTEST_ASSERT_EQ(sha256[i], hash<SHA256>(data[i]));
+        GTEST_ASSERT_EQ(sha224[i], hash<SHA224>(data[i]));
+        GTEST_ASSERT_EQ(sha1[i], hash<SHA1>(data[i]));
+        GTEST_ASSERT_EQ(hmac[i], hash<HMAC<SHA256>>(data[i], "key"));
+    }
+    auto re = hashBatch<SHA256>(std::vector<std::string>{"", "Hello, World!"});
+    GTEST_ASSERT_EQ(re[1], hash<SHA256>("Hello, World!"));
+}
+
 TEST(HashLibTest, MD5Test) {
     GTEST_ASSERT_EQ(hashHex<MD5>(""), "d41d8cd98f00b204e9800998ecf8427e");
     GTEST_ASSERT_EQ(hashHex<MD5>("Hello, World!"), "65a8e27d8879283831b664bd8b7f0ad4");
     GTEST_ASSERT_EQ(hashHex<MD5>("随便来一些中文。测试超过一百二十八字节时的状况。用于测试是否存在问题。还是不够长呢。啊啊啊。"), "bbf4521fa0a37519d277660cb10805d1");
 }
 
+TEST(HashLibTest, UpdateChunkTest) {
+    std::vector<uint8_t> data(5000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i % 253;
+    for (size_t chunk : {1, 63, 64, 65, 127, 128, 129, 1000}) {
+        SHA1 sha1;
+        SHA256 sha256;
+        SHA512 sha512;
+        MD5 md5;
+        for (size_t i = 0; i < data.size(); i += chunk) {
+            size_t len = std::min(chunk, data.size() - i);
+            sha1.update(data.data() + i, len);
+            sha256.update(data.data() + i, len);
+            sha512.update(data.data() + i, len);
+            md5.update(data.data() + i, len);
+        }
+        GTEST_ASSERT_EQ(sha1.digest(), hash<SHA1>(data));
+        GTEST_ASSERT_EQ(sha256.digest(), hash<SHA256>(data));
+        GTEST_ASSERT_EQ(sha512.digest(), hash<SHA512>(data));
+        GTEST_ASSERT_EQ(md5.digest(), hash<MD5>(data));
+    }
+    GTEST_ASSERT_EQ(hashHex<MD5>(data), "88f59225449c2e007778900f134c994d");
+}
+
 TEST(HashLibTest, HMACClassTest) {
     HMAC<SHA512> hmac("key");
     hmac.update("Hello, World!");
@@ -68,6 +171,33 @@ TEST(HashLibTest, HMACClassTest) {
     hmac.clean();
     hmac.update("Hello, World!");
     GTEST_ASSERT_EQ(hmac.hexDigest(), "7b735ac190ebd1432d56f95ae2aea5a04a23128f4c228e299b7a49fb7561de8cc8f4fdf4486dc743dfd07827d617273aab42b3bf819d243ded322fac167419f1");
+    // Finishing twice gives the same result, reset starts again from the keyed state.
+    GTEST_ASSERT_EQ(hmac.hexDigest(), "7b735ac190ebd1432d56f95ae2aea5a04a23128f4c228e299b7a49fb7561de8cc8f4fdf4486dc743dfd07827d617273aab42b3bf819d243ded322fac167419f1");
+    for (int i = 0; i < 3; i++) {
+        hmac.reset();
+        hmac.update("message " + std::to_string(i));
+        GTEST_ASSERT_EQ(hmac.digest(), hash<HMAC<SHA512>>("message " + std::to_string(i), "key"));
+    }
+}
+
+// The digest of a long key is longer than the 1-byte block of CRC32 and CRC32C, only its first byte keys the HMAC
+template<class H>
+static void checkShortBlockHMAC() {
+    std::string key = "a key longer than one block";
+    std::string message = "message";
+    uint8_t shortKey = hash<H>(key)[0];
+    std::vector<uint8_t> inner = { (uint8_t)(shortKey ^ 0x36) };
+    inner.insert(inner.end(), message.begin(), message.end());
+    std::vector<uint8_t> outer = { (uint8_t)(shortKey ^ 0x5c) };
+    auto innerDigest = hash<H>(inner);
+    outer.insert(outer.end(), innerDigest.begin(), innerDigest.end());
+    GTEST_ASSERT_EQ(hash<HMAC<H>>(message, key), hash<H>(outer));
+    GTEST_ASSERT_EQ(hash<HMAC<H>>(message, std::string(1, (char)shortKey)), hash<H>(outer));
+}
+
+TEST(HashLibTest, HMACShortBlockTest) {
+    checkShortBlockHMAC<CRC32>();
+    checkShortBlockHMAC<CRC32C>();
 }
 
 TEST(HashLibTest, HMACTest) {
@@ -75,3 +205,591 @@ TEST(HashLibTest, HMACTest) {
     GTEST_ASSERT_EQ(hashHex<HMAC<SHA1>>("1dakljda", "abc"), "f1d5dadc84af9f826601f1d6682c1a5cf1a60751");
     GTEST_ASSERT_EQ(hashHex<HMAC<SHA1>>("随便来一些中文。测试超过一百二十八字节时的状况。用于测试是否存在问题。还是不够长呢。啊啊啊。", "abc"), "7baac227c3f24787e906d9b8e11283945f5d38b3");
 }
+
+TEST(HashLibTest, HashFileTest) {
+    std::string path = "hash_lib_test_file.bin";
+    std::vector<uint8_t> data(3 * 1024 * 1024 + 17);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 31 + (i >> 9));
+    FILE* f = fileop::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fileop::fclose(f);
+    GTEST_ASSERT_EQ(hashHexFile<SHA256>(path), hashHex<SHA256>(data));
+    GTEST_ASSERT_EQ(hashFile<SHA512>(path), hash<SHA512>(data));
+    SHA256 mapped;
+    GTEST_ASSERT_TRUE(mapped.updateFile(path, true));
+    GTEST_ASSERT_EQ(mapped.digest(), hash<SHA256>(data));
+    GTEST_ASSERT_EQ(hashFileMapped<SHA512>(path), hash<SHA512>(data));
+    GTEST_ASSERT_EQ(hashHexFileMapped<BLAKE3>(path), hashHex<BLAKE3>(data));
+    f = fileop::fopen(path, "wb");
+    fileop::fclose(f);
+    GTEST_ASSERT_EQ(hashHexFile<SHA256>(path), hashHex<SHA256>(""));
+    GTEST_ASSERT_EQ(hashHexFileMapped<SHA256>(path), hashHex<SHA256>(""));
+    fileop::remove(path);
+    GTEST_ASSERT_EQ(hashHexFile<SHA256>(path), "");
+    GTEST_ASSERT_TRUE(hashFile<SHA256>(path).empty());
+    GTEST_ASSERT_TRUE(hashFileMapped<SHA256>(path).empty());
+}
+
+#if !_WIN32
+TEST(HashLibTest, HashFileTruncatedTest) {
+    std::string path = "hash_lib_test_truncated.bin";
+    std::vector<uint8_t> data(32 << 20, 'a');
+    FILE* f = fileop::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fileop::fclose(f);
+    // Truncating the file while it is hashed ends the hash early instead of crashing
+    SHA256 h;
+    std::thread truncator([&]() {
+        GTEST_ASSERT_EQ(truncate(path.c_str(), 4096), 0);
+    });
+    GTEST_ASSERT_TRUE(h.updateFile(path));
+    truncator.join();
+    fileop::remove(path);
+}
+#endif
+
+TEST(HashLibTest, HashFilePipelinedTest) {
+    std::string path = "hash_lib_test_pipelined.bin";
+    std::vector<uint8_t> data(1024 * 1024 + 4097);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7 + (i >> 11));
+    FILE* f = fileop::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fileop::fclose(f);
+    auto expected = hash<SHA256>(data);
+    GTEST_ASSERT_EQ(hashFilePipelined<SHA256>(path, 4 << 20, 2), expected);
+    GTEST_ASSERT_EQ(hashFilePipelined<SHA256>(path, 4096, 1), expected);
+    GTEST_ASSERT_EQ(hashFilePipelined<SHA256>(path, 65536, 8), expected);
+    SHA1 sha1;
+    GTEST_ASSERT_TRUE(sha1.updateFilePipelined(path, 1000, 3));
+    GTEST_ASSERT_EQ(sha1.digest(), hash<SHA1>(data));
+    fileop::remove(path);
+    GTEST_ASSERT_TRUE(hashFilePipelined<SHA256>(path, 4096, 2).empty());
+}
+
+TEST(HashLibTest, BLAKE3Test) {
+    GTEST_ASSERT_EQ(hashHex<BLAKE3>(""), "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262");
+    GTEST_ASSERT_EQ(hashHex<BLAKE3>("abc"), "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85");
+    GTEST_ASSERT_EQ(hashHex<BLAKE3>("Hello, World!"), "288a86a79f20a3d6dccdca7713beaed178798296bdfa7913fa2a62d9727bf8f8");
+    BLAKE3 xof;
+    uint8_t out[100];
+    xof.finish(out);
+    // Extended output, the first 32 bytes are the digest.
+    GTEST_ASSERT_EQ(std::vector<uint8_t>(out, out + 32), hash<BLAKE3>(""));
+    std::vector<uint8_t> tail = {
+        0x26, 0xf5, 0x48, 0x77, 0x89, 0xe8, 0xf6, 0x60, 0xaf, 0xe6, 0xc9, 0x9e, 0xf9, 0xe0, 0xc5, 0x2b, 0x92, 0xe7,
+        0x39, 0x30, 0x24, 0xa8, 0x04, 0x59, 0xcf, 0x91, 0xf4, 0x76, 0xf9, 0xff, 0xdb, 0xda, 0x70, 0x01, 0xc2, 0x2e};
+    GTEST_ASSERT_EQ(std::vector<uint8_t>(out + 64, out + 100), tail);
+}
+
+TEST(HashLibTest, BLAKE3ThreadsTest) {
+    // Subtrees of up to 8 MiB, split into up to 64 parts
+    std::vector<uint8_t> data(9 * 1024 * 1024 + 12345);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7 + (i >> 10));
+    auto expected = hash<BLAKE3>(data);
+    for (unsigned int threads : {2u, 3u, 8u, 64u}) {
+        GTEST_ASSERT_EQ(hash<BLAKE3>(data, threads), expected);
+    }
+    // The file path reads large chunks when threads are used
+    std::string path = "hash_lib_test_blake3_threads.bin";
+    FILE* f = fileop::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fileop::fclose(f);
+    GTEST_ASSERT_EQ(hashFile<BLAKE3>(path, 8u), expected);
+    GTEST_ASSERT_EQ(hashFileMapped<BLAKE3>(path, 8u), expected);
+    // Concurrent hashes share the worker pool
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches { 0 };
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&]() {
+            if (hashFile<BLAKE3>(path, 4u) != expected) mismatches++;
+        });
+    }
+    for (auto& t : threads) t.join();
+    GTEST_ASSERT_EQ(mismatches, 0);
+    fileop::remove(path);
+}
+
+TEST(HashLibTest, BLAKE3LongTest) {
+    std::vector<uint8_t> data(1000003);
+    for (size_t i = 0; i < data.size(); i++) data[i] = i % 251;
+    const char* expected = "cd5a3272e01b1a2f47bb4565d8d202db0f95704d32550a2da61a0fd363d4c90d";
+    for (int hw = 0; hw < 2; hw++) {
+        setHardwareAcceleration(hw);
+        GTEST_ASSERT_EQ(hashHex<BLAKE3>(data), expected);
+        GTEST_ASSERT_EQ(hashHex<BLAKE3>(data, 4u), expected);
+        for (size_t chunk : {1u, 1000u, 1024u, 65537u}) {
+            BLAKE3 b3;
+            for (size_t i = 0; i < data.size(); i += chunk) {
+                b3.update(data.data() + i, std::min(chunk, data.size() - i));
+            }
+            GTEST_ASSERT_EQ(b3.hexDigest(), expected);
+        }
+    }
+    setHardwareAcceleration(true);
+}
+
+TEST(HashLibTest, CRC32Test) {
+    GTEST_ASSERT_EQ(hashHex<CRC32>(""), "00000000");
+    GTEST_ASSERT_EQ(hashHex<CRC32>("123456789"), "cbf43926");
+    GTEST_ASSERT_EQ(hashHex<CRC32>("Hello, World!"), "ec4ac3d0");
+    GTEST_ASSERT_EQ(hashHex<CRC32C>(""), "00000000");
+    GTEST_ASSERT_EQ(hashHex<CRC32C>("123456789"), "e3069283");
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 131 + (i >> 7));
+    for (int hw = 0; hw < 2; hw++) {
+        setHardwareAcceleration(hw);
+        CRC32 crc32;
+        CRC32C crc32c;
+        crc32.update(data);
+        crc32c.update(data);
+        GTEST_ASSERT_EQ(crc32.value(), 0xdacb0ccd);
+        GTEST_ASSERT_EQ(crc32c.value(), 0xbc339f46);
+        // Checksums of pieces combined, the pieces start at unaligned offsets.
+        for (size_t split : {1u, 3u, 100u, 24577u, 99999u}) {
+            CRC32 a, b;
+            CRC32C c, d;
+            a.update(data.data(), split);
+            b.update(data.data() + split, data.size() - split);
+            c.update(data.data(), split);
+            d.update(data.data() + split, data.size() - split);
+            GTEST_ASSERT_EQ(CRC32::combine(a.value(), b.value(), data.size() - split), 0xdacb0ccd);
+            GTEST_ASSERT_EQ(CRC32C::combine(c.value(), d.value(), data.size() - split), 0xbc339f46);
+        }
+    }
+    setHardwareAcceleration(true);
+}
+
+TEST(HashLibTest, XXH3Test) {
+    GTEST_ASSERT_EQ(hashHex<XXH3_64>(""), "2d06800538d394c2");
+    GTEST_ASSERT_EQ(hashHex<XXH3_64>("abc"), "78af5f94892f3950");
+    GTEST_ASSERT_EQ(hashHex<XXH3_128>("Hello, World!"), "531df2844447dd5077db03842cd75395");
+    GTEST_ASSERT_EQ(xxh3Hash64("Hello, World!", 13), 0x60415d5f616602aaULL);
+    GTEST_ASSERT_EQ(XXH3Hasher()(std::string("abc")), (size_t)0x78af5f94892f3950ULL);
+    // Mutable C strings are hashed by content, as const ones
+    char buf[] = "abc";
+    GTEST_ASSERT_EQ(XXH3Hasher()(buf), (size_t)0x78af5f94892f3950ULL);
+    GTEST_ASSERT_EQ(XXH3Hasher()((char*)buf), XXH3Hasher()((const char*)buf));
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 131 + (i >> 7));
+    XXH128Value expected = { 0x2cd0201f176772d1ULL, 0x9fb3eb41b5d413f7ULL };
+    for (int hw = 0; hw < 2; hw++) {
+        setHardwareAcceleration(hw);
+        GTEST_ASSERT_EQ(xxh3Hash64(data.data(), data.size()), 0x45f0da7a5698d41bULL);
+        GTEST_ASSERT_EQ(xxh3Hash64(data.data(), data.size(), 42), 0x2cd0201f176772d1ULL);
+        GTEST_ASSERT_TRUE(xxh3Hash128(data.data(), data.size(), 42) == expected);
+        // Streaming with chunks which do not line up with stripes or the internal buffer
+        for (size_t chunk : {1u, 63u, 256u, 1000u}) {
+            XXH3_64 h(42);
+            XXH3_128 h2(42);
+            for (size_t p = 0; p < data.size(); p += chunk) {
+                size_t len = std::min(chunk, data.size() - p);
+                h.update(data.data() + p, len);
+                h2.update(data.data() + p, len);
+            }
+            GTEST_ASSERT_EQ(h.value(), 0x2cd0201f176772d1ULL);
+            GTEST_ASSERT_TRUE(h2.value() == expected);
+        }
+    }
+    setHardwareAcceleration(true);
+}
+
+
+TEST(HashLibTest, SHA3Test) {
+    GTEST_ASSERT_EQ(hashHex<SHA3_224>(""), "6b4e03423667dbb73b6e15454f0eb1abd4597f9a1b078e3f5b5a6bc7");
+    GTEST_ASSERT_EQ(hashHex<SHA3_256>("abc"), "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532");
+    GTEST_ASSERT_EQ(hashHex<SHA3_384>("abc"), "ec01498288516fc926459f58e2c6ad8df9b473cb0fc08c2596da7cf0e49be4b298d88cea927ac7f539f1edf228376d25");
+    GTEST_ASSERT_EQ(hashHex<SHA3_512>("abc"), "b751850b1a57168a5693cd924b6b096e08f621827444f70d884f5d0240d2712e10e116e9192af3c91a7ec57647e3934057340b4cf408d5a56592f8274eec53f0");
+    GTEST_ASSERT_EQ(hashHex<SHAKE128>(""), "7f9c2ba4e88f827d616045507605853ed73b8093f6efbc88eb1a6eacfa66ef26");
+    GTEST_ASSERT_EQ(hashHex<SHAKE256>("abc"), "483366601360a8771c6863080cc4114d8db44530f8f1e1ee4f94ea37e78b5739d5a15bef186a5386c75744c0527e1faa9f8726e462a12a4feb06bd8801e751e4");
+    GTEST_ASSERT_EQ(hashHex<HMAC<SHA3_256>>("The quick brown fox jumps over the lazy dog", "key"), "8c6e0683409427f8931711b10ca92a506eb1fafa48fadd66d76126f47ac2c333");
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 131 + (i >> 7));
+    GTEST_ASSERT_EQ(hashHex<SHA3_256>(data), "26e881558ee80865e6c0bd7ab39e4335f61541d581c49eb79e180742e5b66212");
+    // The batch path runs 4 states at once, lengths straddle the rate (136 bytes).
+    std::vector<std::vector<uint8_t>> messages;
+    for (size_t len : {0u, 1u, 135u, 136u, 137u, 272u, 1000u}) {
+        messages.emplace_back(data.begin(), data.begin() + len);
+    }
+    for (int hw = 0; hw < 2; hw++) {
+        setHardwareAcceleration(hw);
+        auto re = hashBatch<SHA3_256>(messages);
+        for (size_t i = 0; i < messages.size(); i++) {
+            GTEST_ASSERT_EQ(re[i], hash<SHA3_256>(messages[i]));
+        }
+    }
+    setHardwareAcceleration(true);
+}
+
+static std::string toHex(const std::vector<uint8_t>& data) {
+    std::string hex;
+    for (auto i : data) {
+        char buf[3];
+        snprintf(buf, sizeof(buf), "%02x", i);
+        hex += buf;
+    }
+    return hex;
+}
+
+TEST(HashLibTest, PBKDF2Test) {
+    GTEST_ASSERT_EQ(toHex(pbkdf2<SHA1>("password", "salt", 4096, 20)), "4b007901b765489abead49d926f721d065a429c1");
+    GTEST_ASSERT_EQ(toHex(pbkdf2<SHA256>("passwd", "salt", 1, 64)), "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783");
+    // 2 blocks, derived on 1 or 2 threads
+    std::string expected = "afe6c5530785b6cc6b1c6453384731bd5ee432ee549fd42fb6695779ad8a1c5bf59de69c48f774efc4007d5298f9033c0241d5ab69305e7b64eceeb8d834cfec6afdec3c1c23982a121f2d4be008889378a49a0dfb104f0d2856e38f44271cdaf6de4341";
+    GTEST_ASSERT_EQ(toHex(pbkdf2<SHA512>("password", "salt", 1000, 100, 1)), expected);
+    GTEST_ASSERT_EQ(toHex(pbkdf2<SHA512>("password", "salt", 1000, 100, 2)), expected);
+    GTEST_ASSERT_TRUE(pbkdf2<SHA256>("password", "salt", 0, 32).empty());
+    if (sizeof(size_t) > 4) {
+        // More than 2^32 - 1 blocks would wrap the block index
+        GTEST_ASSERT_TRUE(pbkdf2<SHA1>("password", "salt", 1, (size_t)0xffffffffull * 20 + 1).empty());
+    }
+}
+
+TEST(HashLibTest, HKDFTest) {
+    // RFC 5869 test case 1
+    std::vector<uint8_t> ikm(22, 0x0b), salt, info;
+    for (uint8_t i = 0; i <= 0x0c; i++) salt.push_back(i);
+    for (uint8_t i = 0xf0; i <= 0xf9; i++) info.push_back(i);
+    auto prk = hkdfExtract<SHA256>(salt.data(), salt.size(), ikm.data(), ikm.size());
+    GTEST_ASSERT_EQ(toHex(prk), "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5");
+    auto okm = hkdf<SHA256>(ikm.data(), ikm.size(), salt.data(), salt.size(), info.data(), info.size(), 42);
+    GTEST_ASSERT_EQ(toHex(okm), "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865");
+    // RFC 5869 test case 3, empty salt and info
+    okm = hkdf<SHA256>(ikm.data(), ikm.size(), nullptr, 0, nullptr, 0, 42);
+    GTEST_ASSERT_EQ(toHex(okm), "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d9d201395faa4b61a96c8");
+    GTEST_ASSERT_TRUE(hkdf<SHA256>("ikm", "salt", "info", 255 * 32 + 1).empty());
+}
+
+template<class H>
+static void checkStateResume(H fresh) {
+    std::vector<uint8_t> data(3000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 31 + 7);
+    H one = fresh;
+    auto expected = one.update(data)->digest();
+    for (size_t split : {0, 1, 63, 64, 65, 200, 1024, 1025, 2999}) {
+        H first = fresh;
+        first.update(data.data(), split);
+        auto state = first.exportState();
+        GTEST_ASSERT_FALSE(state.empty());
+        H second = fresh;
+        second.update("garbage");
+        GTEST_ASSERT_TRUE(second.importState(state));
+        second.update(data.data() + split, data.size() - split);
+        GTEST_ASSERT_EQ(second.digest(), expected);
+    }
+}
+
+TEST(HashLibTest, ExportStateTest) {
+    checkStateResume(SHA1());
+    checkStateResume(SHA224());
+    checkStateResume(SHA256());
+    checkStateResume(SHA384());
+    checkStateResume(SHA512());
+    checkStateResume(MD5());
+    checkStateResume(BLAKE3());
+    checkStateResume(CRC32());
+    checkStateResume(CRC32C());
+    checkStateResume(XXH3_64());
+    checkStateResume(XXH3_64(12345));
+    checkStateResume(XXH3_128());
+    checkStateResume(SHA3_256());
+    checkStateResume(SHAKE256(100));
+
+    SHA256 sha;
+    sha.update("hello");
+    auto state = sha.exportState();
+    // Another algorithm or a corrupted state is rejected and keeps the current state
+    SHA224 sha224;
+    GTEST_ASSERT_FALSE(sha224.importState(state));
+    SHA3_256 sha3;
+    GTEST_ASSERT_FALSE(sha3.importState(SHA3_512().update("hello")->exportState()));
+    auto corrupted = state;
+    corrupted[10] ^= 1;
+    GTEST_ASSERT_FALSE(sha.importState(corrupted));
+    GTEST_ASSERT_FALSE(sha.importState(state.data(), state.size() - 1));
+    GTEST_ASSERT_EQ(sha.update(" world")->digest(), SHA256().update("hello world")->digest());
+    // No state after finishing
+    sha.digest();
+    GTEST_ASSERT_TRUE(sha.exportState().empty());
+}
+
+// Forwards reads but can not seek
+class SequentialReadStream : public ReadStream {
+public:
+    SequentialReadStream(ReadStream* source) : source(source) {}
+    virtual size_t read(uint8_t* buf, size_t size) override {
+        return source->read(buf, size > 100 ? 100 : size);
+    }
+    virtual bool seekable() override { return false; }
+    virtual bool eof() override { return source->eof(); }
+    virtual bool error() override { return source->error(); }
+    virtual bool close() override { return true; }
+private:
+    ReadStream* source;
+};
+
+TEST(HashLibTest, MerkleTest) {
+    std::vector<uint8_t> data(10000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7 + 3);
+    MemReadStream stream(data);
+    MerkleTree tree;
+    for (unsigned int threads : {1, 4}) {
+        GTEST_ASSERT_TRUE(MerkleHasher<SHA256>(1000, threads).hash(stream, tree));
+        GTEST_ASSERT_EQ(tree.length, 10000);
+        GTEST_ASSERT_EQ(tree.leaves.size(), 10);
+        GTEST_ASSERT_EQ(toHex(tree.root), "ede6727f4cb443d14cb129a32c89c85d2a0602f2b9267a983e8889998f196a7a");
+        GTEST_ASSERT_EQ(tree.leaves[9], MerkleHasher<SHA256>::leafHash(data.data() + 9000, 1000));
+    }
+    GTEST_ASSERT_TRUE(MerkleHasher<SHA256>(4096).hash(stream, tree));
+    GTEST_ASSERT_EQ(tree.leaves.size(), 3);
+    GTEST_ASSERT_EQ(toHex(tree.root), "5cbf1591e4223362a720b827772968c3832f4c7c9fcbf63b8e368dbd388068de");
+    GTEST_ASSERT_EQ(tree.root, MerkleHasher<SHA256>::rootOf(tree.leaves));
+    GTEST_ASSERT_EQ(stream.tell(), 0);
+    // Sequential reads give the same tree
+    SequentialReadStream sequential(&stream);
+    MerkleTree tree2;
+    GTEST_ASSERT_TRUE(MerkleHasher<SHA256>(4096).hash(sequential, tree2));
+    GTEST_ASSERT_EQ(tree2.root, tree.root);
+    GTEST_ASSERT_EQ(tree2.length, 10000);
+    // A region of the stream
+    ReadStreamRegion region(&stream, 0, 4096);
+    GTEST_ASSERT_TRUE(MerkleHasher<SHA256>(4096).hash(region, tree2));
+    GTEST_ASSERT_EQ(tree2.root, tree.leaves[0]);
+    // Empty data
+    MemReadStream empty(std::vector<uint8_t>{});
+    GTEST_ASSERT_TRUE(MerkleHasher<SHA256>().hash(empty, tree2));
+    GTEST_ASSERT_TRUE(tree2.leaves.empty());
+    GTEST_ASSERT_EQ(tree2.root, hash<SHA256>(""));
+}
+
+TEST(HashLibTest, FastCDCTest) {
+    std::vector<uint8_t> data(1 << 20);
+    uint64_t x = 1;
+    for (auto& i : data) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        i = (uint8_t)(x >> 56);
+    }
+    FastCDC cdc(1024, 4096, 16384);
+    auto chunks = cdc.chunk<SHA256>(data);
+    uint64_t offset = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        GTEST_ASSERT_EQ(chunks[i].offset, offset);
+        GTEST_ASSERT_LE(chunks[i].length, 16384);
+        if (i + 1 < chunks.size()) {
+            GTEST_ASSERT_GE(chunks[i].length, 1024);
+        }
+        GTEST_ASSERT_EQ(chunks[i].digest, hash<SHA256>(data.data() + offset, chunks[i].length));
+        offset += chunks[i].length;
+    }
+    GTEST_ASSERT_EQ(offset, data.size());
+    GTEST_ASSERT_GT(chunks.size(), 100);
+    GTEST_ASSERT_LT(chunks.size(), 400);
+    // The stream gives the same chunks
+    MemReadStream stream(data);
+    std::vector<CDCChunk> streamChunks;
+    GTEST_ASSERT_TRUE(cdc.chunk<SHA256>(stream, streamChunks));
+    GTEST_ASSERT_EQ(streamChunks.size(), chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        GTEST_ASSERT_EQ(streamChunks[i].offset, chunks[i].offset);
+        GTEST_ASSERT_EQ(streamChunks[i].digest, chunks[i].digest);
+    }
+    // An inserted byte only changes the chunks around it
+    auto modified = data;
+    modified.insert(modified.begin() + 500000, 0x42);
+    auto modifiedChunks = cdc.chunk<SHA256>(modified);
+    std::set<std::vector<uint8_t>> digests;
+    for (auto& c : chunks) digests.insert(c.digest);
+    size_t changed = 0;
+    for (auto& c : modifiedChunks) changed += digests.count(c.digest) ? 0 : 1;
+    GTEST_ASSERT_LE(changed, 2);
+    GTEST_ASSERT_TRUE(cdc.chunk<SHA256>(nullptr, 0).empty());
+}
+
+TEST(HashLibTest, HexDigestTest) {
+    GTEST_ASSERT_EQ(hashHex<SHA256>("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    char buf[65];
+    SHA256 sha;
+    sha.update("abc");
+    GTEST_ASSERT_FALSE(sha.hexDigest(buf, 64));
+    GTEST_ASSERT_TRUE(sha.hexDigest(buf, sizeof(buf)));
+    GTEST_ASSERT_EQ(std::string(buf), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // Longer than the stack buffer
+    std::vector<char> longBuf(201);
+    SHAKE128 shake(100);
+    GTEST_ASSERT_TRUE(shake.hexDigest(longBuf.data(), longBuf.size()));
+    GTEST_ASSERT_EQ(std::string(longBuf.data()), hashHex<SHAKE128>("", 100));
+}
+
+template<class H>
+static void checkDigestArray() {
+    H h;
+    GTEST_ASSERT_EQ((size_t)h.digestLength(), H::DIGEST_LENGTH);
+    GTEST_ASSERT_EQ((size_t)h.blockSize(), H::BLOCK_SIZE);
+    std::string data(1000, 'x');
+    Digest<H> d = hashDigest<H>(data);
+    GTEST_ASSERT_EQ(std::vector<uint8_t>(d.begin(), d.end()), hash<H>(data));
+    h.update(data);
+    GTEST_ASSERT_TRUE(finishDigest(h) == d);
+}
+
+TEST(HashLibTest, DigestArrayTest) {
+    checkDigestArray<SHA1>();
+    checkDigestArray<SHA224>();
+    checkDigestArray<SHA256>();
+    checkDigestArray<SHA384>();
+    checkDigestArray<SHA512>();
+    checkDigestArray<SHA512_256>();
+    checkDigestArray<MD5>();
+    checkDigestArray<BLAKE3>();
+    checkDigestArray<CRC32>();
+    checkDigestArray<CRC32C>();
+    checkDigestArray<SHA3_224>();
+    checkDigestArray<SHA3_256>();
+    checkDigestArray<SHA3_384>();
+    checkDigestArray<SHA3_512>();
+    checkDigestArray<SHAKE128>();
+    checkDigestArray<SHAKE256>();
+    checkDigestArray<XXH3_64>();
+    checkDigestArray<XXH3_128>();
+    static_assert(sizeof(Digest<SHA256>) == 32, "SHA-256 digest is 32 bytes");
+    static_assert(HMAC<SHA512>::BLOCK_SIZE == 128, "HMAC uses the block size of the hash");
+    auto mac = hashDigest<HMAC<SHA256>>("data", "key");
+    GTEST_ASSERT_EQ(std::vector<uint8_t>(mac.begin(), mac.end()), hash<HMAC<SHA256>>("data", "key"));
+}
+
+TEST(HashLibTest, ConstexprTest) {
+    static_assert(hexEquals(sha256Constexpr(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"), "SHA-256 of empty string");
+    static_assert(hexEquals(sha256Constexpr("abc"), "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD"), "SHA-256 of abc");
+    static_assert(hexEquals(md5Constexpr("The quick brown fox jumps over the lazy dog"), "9e107d9d372bb6826bd81d3542a419d6"), "MD5");
+    static_assert(crc32Constexpr("123456789") == 0xcbf43926, "CRC-32 check value");
+    static_assert(crc32Constexpr("6789", crc32Constexpr("12345")) == 0xcbf43926, "CRC-32 continued");
+    static_assert(!hexEquals(md5Constexpr(""), "d41d8cd98f00b204e9800998ecf8427f00"), "length mismatch");
+    // The same as the runtime implementations around the padding boundaries
+    std::string data;
+    for (int i = 0; i < 200; i++) {
+        auto sha = sha256Constexpr(data);
+        auto md5 = md5Constexpr(data);
+        GTEST_ASSERT_TRUE(sha == hashDigest<SHA256>(data));
+        GTEST_ASSERT_TRUE(md5 == hashDigest<MD5>(data));
+        CRC32 crc;
+        crc.update(data);
+        GTEST_ASSERT_EQ(crc32Constexpr(data), crc.value());
+        data += (char)(i * 13 + 200);
+    }
+}
+
+TEST(HashLibTest, HashFilesTest) {
+    std::vector<std::string> paths;
+    std::vector<std::vector<uint8_t>> contents;
+    for (size_t i = 0; i < 6; i++) {
+        std::string path = "hash_lib_test_files_" + std::to_string(i) + ".bin";
+        std::vector<uint8_t> data(i * i * 50000);
+        for (size_t j = 0; j < data.size(); j++) data[j] = (uint8_t)(j * 7 + i);
+        FILE* f = fileop::fopen(path, "wb");
+        ASSERT_NE(f, nullptr);
+        if (!data.empty()) fwrite(data.data(), 1, data.size(), f);
+        fileop::fclose(f);
+        paths.push_back(path);
+        contents.push_back(data);
+    }
+    paths.push_back("hash_lib_test_files_missing.bin");
+    // A budget smaller than the largest files, so some of them are hashed alone
+    auto results = hashFiles<SHA256>(paths, 3, 500000);
+    GTEST_ASSERT_EQ(results.size(), paths.size());
+    for (size_t i = 0; i < contents.size(); i++) {
+        GTEST_ASSERT_EQ(results[i].path, paths[i]);
+        GTEST_ASSERT_TRUE(results[i].ok());
+        GTEST_ASSERT_EQ(results[i].size, contents[i].size());
+        GTEST_ASSERT_EQ(results[i].digest, hash<SHA256>(contents[i]));
+    }
+    GTEST_ASSERT_FALSE(results.back().ok());
+    GTEST_ASSERT_EQ(results.back().error, ENOENT);
+    GTEST_ASSERT_TRUE(results.back().digest.empty());
+    results = hashFiles<BLAKE3>(paths, 1);
+    GTEST_ASSERT_EQ(results[5].digest, hash<BLAKE3>(contents[5]));
+    for (size_t i = 0; i < contents.size(); i++) fileop::remove(paths[i]);
+    GTEST_ASSERT_TRUE(hashFiles<SHA256>({}).empty());
+#if !_WIN32
+    // A file which opens but can not be read reports its own errno, the others are still hashed
+    std::string path = "hash_lib_test_files_ok.bin";
+    FILE* f = fileop::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite("abc", 1, 3, f);
+    fileop::fclose(f);
+    results = hashFiles<SHA256>({ ".", path });
+    GTEST_ASSERT_EQ(results[0].error, EISDIR);
+    GTEST_ASSERT_TRUE(results[0].digest.empty());
+    GTEST_ASSERT_TRUE(results[1].ok());
+    GTEST_ASSERT_EQ(results[1].digest, hash<SHA256>("abc"));
+    fileop::remove(path);
+#endif
+}
+
+TEST(HashLibTest, HashFilesScheduleTest) {
+    std::vector<std::string> paths;
+    std::map<std::string, uint64_t> sizes;
+    for (size_t i = 0; i < 8; i++) {
+        // Distinct sizes out of order: 10000, 40000, 70000, 20000, ...
+        size_t size = ((i * 3) % 8 + 1) * 10000;
+        std::string path = "hash_lib_test_schedule_" + std::to_string(i) + ".bin";
+        std::vector<uint8_t> data(size, (uint8_t)i);
+        FILE* f = fileop::fopen(path, "wb");
+        ASSERT_NE(f, nullptr);
+        fwrite(data.data(), 1, data.size(), f);
+        fileop::fclose(f);
+        paths.push_back(path);
+        sizes[path] = size;
+    }
+    std::mutex mutex;
+    std::vector<std::string> started;
+    uint64_t inFlight = 0, peak = 0;
+    const uint64_t budget = 100000;
+    auto hashOne = [&](const std::string& path, std::vector<uint8_t>& digest) {
+        // The scheduler charges files larger than the budget as the whole budget
+        uint64_t cost = sizes[path] < budget ? sizes[path] : budget;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            started.push_back(path);
+            inFlight += cost;
+            peak = inFlight > peak ? inFlight : peak;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        digest = { 1 };
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight -= cost;
+        return true;
+    };
+    // One worker starts the files from the largest to the smallest
+    auto results = internal::hashFiles(paths, 1, budget, hashOne);
+    GTEST_ASSERT_EQ(started.size(), paths.size());
+    for (size_t i = 1; i < started.size(); i++) {
+        GTEST_ASSERT_GT(sizes[started[i - 1]], sizes[started[i]]);
+    }
+    // Many workers keep the bytes in flight within the budget, yet hash files concurrently
+    started.clear();
+    peak = 0;
+    results = internal::hashFiles(paths, 4, budget, hashOne);
+    GTEST_ASSERT_EQ(started.size(), paths.size());
+    GTEST_ASSERT_LE(peak, budget);
+    GTEST_ASSERT_GT(peak, sizes[started[0]]);
+    for (auto& result : results) GTEST_ASSERT_TRUE(result.ok());
+    // A budget smaller than every file hashes them one at a time
+    peak = 0;
+    internal::hashFiles(paths, 4, 5000, [&](const std::string& path, std::vector<uint8_t>& digest) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight++;
+            peak = inFlight > peak ? inFlight : peak;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        digest = { 1 };
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight--;
+        return path.size() > 0;
+    });
+    GTEST_ASSERT_EQ(peak, 1);
+    for (auto& path : paths) fileop::remove(path);
+}
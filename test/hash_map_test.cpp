@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "hash_map.h"
+#include "hash_lib.h"
 #include <string>
 
 TEST(HashMapTest, NextCapTest) {
@@ -83,3 +84,18 @@ TEST(HashMapTest, HashMap2) {
     GTEST_ASSERT_EQ(hash_map_get_entry(map, 15)->value, 225);
     free_hash_map(map);
 }
+
+TEST(HashMapTest, CustomHash) {
+    auto map = hash_map_new<std::string, int, hash_lib::XXH3Hasher>();
+    GTEST_ASSERT_TRUE(map);
+    for (int i = 0; i < 100; i++) {
+        GTEST_ASSERT_TRUE(hash_map_insert(map, std::to_string(i), i));
+    }
+    GTEST_ASSERT_EQ(map->count, 100);
+    GTEST_ASSERT_EQ(map->hash("abc"), hash_lib::XXH3Hasher()("abc"));
+    int v = 0;
+    GTEST_ASSERT_TRUE(hash_map_get(map, "42", v));
+    GTEST_ASSERT_EQ(v, 42);
+    GTEST_ASSERT_FALSE(hash_map_get_entry(map, "100"));
+    free_hash_map(map);
+}
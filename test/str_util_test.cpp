@@ -0,0 +1,40 @@
+#include "gtest/gtest.h"
+#include "str_util.h"
+#include <string>
+
+TEST(StrUtilTest, HexTest) {
+    ASSERT_EQ(str_util::str_hex(""), "");
+    ASSERT_EQ(str_util::str_hex("\x01\xab\xff"), "01abff");
+    // Lengths around the 16-byte SIMD blocks
+    std::string data;
+    for (int i = 0; i < 100; i++) {
+        std::string expected;
+        for (auto c : data) {
+            expected += "0123456789abcdef"[(unsigned char)c >> 4];
+            expected += "0123456789abcdef"[c & 0x0f];
+        }
+        std::string hex = str_util::str_hex(data);
+        ASSERT_EQ(hex, expected);
+        std::string decoded;
+        ASSERT_TRUE(str_util::str_unhex(hex, decoded));
+        ASSERT_EQ(decoded, data);
+        std::string upper;
+        ASSERT_TRUE(str_util::touppercase(hex, upper));
+        ASSERT_TRUE(str_util::str_unhex(upper, decoded));
+        ASSERT_EQ(decoded, data);
+        // A bad character at any position is rejected
+        for (size_t j = 0; j < hex.size(); j++) {
+            for (char bad : { 'g', 'G', '/', ':', '@', '`', ' ', '\x80' }) {
+                std::string broken = hex;
+                broken[j] = bad;
+                ASSERT_FALSE(str_util::str_unhex(broken, decoded)) << broken;
+            }
+        }
+        data += (char)(i * 37 + 11);
+    }
+    char buf[8];
+    str_util::str_hex("\x12\x34", 2, buf);
+    ASSERT_EQ(std::string(buf, 4), "1234");
+    std::string decoded;
+    ASSERT_FALSE(str_util::str_unhex("abc", decoded));
+}
@@ -0,0 +1,242 @@
+#include "gtest/gtest.h"
+#include "stream.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::vector<uint8_t> writeTestFile(const std::string& path, size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) data[i] = (uint8_t)(i * 13 + (i >> 8));
+    FILE* f = fileop::fopen(path, "wb");
+    if (f) {
+        if (size) fwrite(data.data(), 1, data.size(), f);
+        fileop::fclose(f);
+    }
+    return data;
+}
+
+TEST(StreamTest, MmapReadStream) {
+    std::string path = "stream_test_mmap.bin";
+    auto data = writeTestFile(path, 100000);
+    {
+        MmapReadStream stream(path.c_str());
+        ASSERT_FALSE(stream.error());
+        ASSERT_TRUE(stream.seekable());
+        ASSERT_EQ(stream.size(), data.size());
+        ASSERT_EQ(memcmp(stream.data(), data.data(), data.size()), 0);
+        uint8_t buf[1000];
+        ASSERT_EQ(stream.read(buf, sizeof(buf)), sizeof(buf));
+        ASSERT_EQ(memcmp(buf, data.data(), sizeof(buf)), 0);
+        ASSERT_EQ(stream.tell(), 1000);
+        uint32_t value;
+        ASSERT_TRUE(stream.readu32(value));
+        ASSERT_EQ(value, cstr_read_uint32(data.data() + 1000, 0));
+        ASSERT_EQ(stream.read_at(buf, sizeof(buf), 99500), 500);
+        ASSERT_EQ(memcmp(buf, data.data() + 99500, 500), 0);
+        ASSERT_EQ(stream.tell(), 1004);
+        ASSERT_TRUE(stream.seek(-10, SEEK_END));
+        ASSERT_EQ(stream.read(buf, sizeof(buf)), 10);
+        ASSERT_TRUE(stream.eof());
+        ASSERT_FALSE(stream.seek(1, SEEK_END));
+        ASSERT_EQ(stream.view(50000, 100), stream.data() + 50000);
+        ASSERT_EQ(stream.view(99999, 2), nullptr);
+        // Regions read through read_at
+        ReadStreamRegion region(&stream, 2000, 3000);
+        std::vector<uint8_t> part(1000);
+        ASSERT_TRUE(region.readall(part));
+        ASSERT_EQ(memcmp(part.data(), data.data() + 2000, 1000), 0);
+        ASSERT_TRUE(stream.close());
+        ASSERT_EQ(stream.read(buf, sizeof(buf)), 0);
+    }
+    writeTestFile(path, 0);
+    {
+        MmapReadStream stream(path.c_str());
+        ASSERT_FALSE(stream.error());
+        ASSERT_EQ(stream.size(), 0);
+        ASSERT_TRUE(stream.eof());
+        uint8_t buf[1];
+        ASSERT_EQ(stream.read(buf, 1), 0);
+    }
+    fileop::remove(path);
+    MmapReadStream missing(path.c_str());
+    ASSERT_TRUE(missing.error());
+    ASSERT_FALSE(missing.seekable());
+}
+
+TEST(StreamTest, FileReadStreamReadAt) {
+    std::string path = "stream_test_read_at.bin";
+    auto data = writeTestFile(path, 1 << 20);
+    {
+        FileReadStream stream(path.c_str());
+        ASSERT_FALSE(stream.error());
+        uint8_t buf[4096];
+        ASSERT_EQ(stream.read(buf, 100), 100);
+        ASSERT_EQ(stream.read_at(buf, sizeof(buf), 5000), sizeof(buf));
+        ASSERT_EQ(memcmp(buf, data.data() + 5000, sizeof(buf)), 0);
+        // read_at does not move the position of read
+        ASSERT_EQ(stream.tell(), 100);
+        ASSERT_EQ(stream.read(buf, 100), 100);
+        ASSERT_EQ(memcmp(buf, data.data() + 100, 100), 0);
+        ASSERT_EQ(stream.read_at(buf, sizeof(buf), data.size() - 10), 10);
+        ASSERT_EQ(stream.read_at(buf, sizeof(buf), data.size() + 10), 0);
+        ASSERT_FALSE(stream.error());
+        // Concurrent reads
+        std::vector<std::thread> threads;
+        std::atomic<int> mismatches { 0 };
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t]() {
+                uint8_t local[4096];
+                uint64_t x = t + 1;
+                for (int i = 0; i < 500; i++) {
+                    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+                    size_t offset = (x >> 33) % (data.size() - sizeof(local));
+                    if (stream.read_at(local, sizeof(local), offset) != sizeof(local) || memcmp(local, data.data() + offset, sizeof(local))) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (auto& i : threads) i.join();
+        ASSERT_EQ(mismatches, 0);
+        ASSERT_FALSE(stream.error());
+    }
+    fileop::remove(path);
+}
+
+TEST(StreamTest, MemReadStreamMove) {
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)i;
+    const uint8_t* ptr = data.data();
+    MemReadStream stream(std::move(data));
+    ASSERT_EQ(stream.data(), ptr);
+    uint8_t buf[10];
+    ASSERT_EQ(stream.read(buf, sizeof(buf)), sizeof(buf));
+    MemReadStream moved(std::move(stream));
+    ASSERT_EQ(moved.data(), ptr);
+    ASSERT_EQ(moved.size(), 1000);
+    ASSERT_EQ(moved.tell(), 10);
+    ASSERT_TRUE(moved.readu8(buf[0]));
+    ASSERT_EQ(buf[0], 10);
+    MemReadStream copied(moved);
+    ASSERT_NE(copied.data(), ptr);
+    ASSERT_EQ(memcmp(copied.data(), ptr, 1000), 0);
+}
+
+TEST(StreamTest, MemViewReadStream) {
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7);
+    MemViewReadStream stream(data.data(), data.size());
+    ASSERT_EQ(stream.data(), data.data());
+    ASSERT_EQ(stream.size(), data.size());
+    uint8_t buf[100];
+    ASSERT_EQ(stream.read(buf, sizeof(buf)), sizeof(buf));
+    ASSERT_EQ(memcmp(buf, data.data(), sizeof(buf)), 0);
+    ASSERT_EQ(stream.read_at(buf, sizeof(buf), 950), 50);
+    ASSERT_EQ(memcmp(buf, data.data() + 950, 50), 0);
+    ASSERT_EQ(stream.tell(), 100);
+    ASSERT_TRUE(stream.seek(-1, SEEK_END));
+    ASSERT_TRUE(stream.readu8(buf[0]));
+    ASSERT_EQ(buf[0], data[999]);
+    ASSERT_TRUE(stream.eof());
+    ASSERT_FALSE(stream.seek(1, SEEK_END));
+    ASSERT_EQ(stream.view(10, 20), data.data() + 10);
+    ASSERT_EQ(stream.view(990, 20), nullptr);
+    ReadStreamRegion region(&stream, 200, 300);
+    std::vector<uint8_t> part(100);
+    ASSERT_TRUE(region.readall(part));
+    ASSERT_EQ(memcmp(part.data(), data.data() + 200, 100), 0);
+
+    MemViewReadStream empty(nullptr, 10);
+    ASSERT_EQ(empty.size(), 0);
+    ASSERT_TRUE(empty.eof());
+    ASSERT_EQ(empty.read(buf, 1), 0);
+
+    // Shared ownership keeps the buffer alive
+    auto shared = std::make_shared<const std::vector<uint8_t>>(data);
+    const uint8_t* ptr = shared->data();
+    MemViewReadStream owning(std::move(shared));
+    ASSERT_EQ(owning.data(), ptr);
+    ASSERT_EQ(owning.read(buf, sizeof(buf)), sizeof(buf));
+    ASSERT_EQ(memcmp(buf, data.data(), sizeof(buf)), 0);
+
+    std::shared_ptr<uint8_t> array(new uint8_t[16](), std::default_delete<uint8_t[]>());
+    array.get()[15] = 42;
+    MemViewReadStream aliased(array, array.get(), 16);
+    array.reset();
+    ASSERT_EQ(aliased.read_at(buf, 1, 15), 1);
+    ASSERT_EQ(buf[0], 42);
+}
+
+TEST(StreamTest, BufferedReadStream) {
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 13 + (i >> 8));
+    MemViewReadStream source(data.data(), data.size());
+    BufferedReadStream stream(&source, 1000, 100);
+    ASSERT_TRUE(stream.seekable());
+    ASSERT_EQ(stream.readahead_size(), 100);
+    // Field by field reads
+    for (size_t i = 0; i < 1000; i++) {
+        uint32_t value;
+        ASSERT_TRUE(stream.readu32(value));
+        ASSERT_EQ(value, cstr_read_uint32(data.data() + i * 4, 0));
+    }
+    ASSERT_EQ(stream.tell(), 4000);
+    // Sequential reads grow the readahead up to the capacity
+    ASSERT_EQ(stream.readahead_size(), 1000);
+    // Peek across the end of the ring buffer
+    for (size_t i = 0; i < 50; i++) {
+        const uint8_t* p = stream.peek(97);
+        ASSERT_NE(p, nullptr);
+        ASSERT_EQ(memcmp(p, data.data() + stream.tell(), 97), 0);
+        ASSERT_TRUE(stream.skip(31));
+    }
+    ASSERT_EQ(stream.peek(1001), nullptr);
+    // Seeks back into consumed bytes and forward into buffered bytes
+    int64_t p = stream.tell();
+    uint8_t buf[300];
+    ASSERT_EQ(stream.read(buf, 10), 10);
+    ASSERT_TRUE(stream.seek(-10, SEEK_CUR));
+    ASSERT_EQ(stream.tell(), p);
+    ASSERT_EQ(stream.read(buf, 20), 20);
+    ASSERT_EQ(memcmp(buf, data.data() + p, 20), 0);
+    ASSERT_EQ(stream.readahead_size(), 1000);
+    // Random seeks shrink the readahead
+    ASSERT_TRUE(stream.seek(50000, SEEK_SET));
+    ASSERT_EQ(stream.readahead_size(), 100);
+    ASSERT_EQ(stream.read(buf, 5), 5);
+    ASSERT_EQ(memcmp(buf, data.data() + 50000, 5), 0);
+    ASSERT_EQ(stream.buffered(), 95);
+    // Large reads bypass the buffer
+    std::vector<uint8_t> large(5000);
+    ASSERT_TRUE(stream.readall(large));
+    ASSERT_EQ(memcmp(large.data(), data.data() + 50005, large.size()), 0);
+    ASSERT_TRUE(stream.seek(-1, SEEK_CUR));
+    ASSERT_TRUE(stream.readu8(buf[0]));
+    ASSERT_EQ(buf[0], data[55004]);
+    ASSERT_EQ(stream.read_at(buf, 100, 10), 100);
+    ASSERT_EQ(memcmp(buf, data.data() + 10, 100), 0);
+    ASSERT_EQ(stream.tell(), 55005);
+    ASSERT_TRUE(stream.seek(-3, SEEK_END));
+    ASSERT_EQ(stream.read(buf, sizeof(buf)), 3);
+    ASSERT_EQ(memcmp(buf, data.data() + data.size() - 3, 3), 0);
+    ASSERT_TRUE(stream.eof());
+    ASSERT_EQ(stream.peek(1), nullptr);
+    ASSERT_FALSE(stream.error());
+
+    // Over a region of a file, where every unbuffered read is a read_at
+    std::string path = "stream_test_buffered.bin";
+    writeTestFile(path, data.size());
+    FileReadStream file(path.c_str());
+    ReadStreamRegion region(&file, 1000, 9000);
+    BufferedReadStream buffered(&region);
+    for (size_t i = 0; i < 2000; i++) {
+        uint32_t value;
+        ASSERT_TRUE(buffered.readu32(value));
+        ASSERT_EQ(value, cstr_read_uint32(data.data() + 1000 + i * 4, 0));
+    }
+    uint8_t byte;
+    ASSERT_FALSE(buffered.readu8(byte));
+    ASSERT_TRUE(buffered.eof());
+    file.close();
+    fileop::remove(path);
+}